@@ -59,6 +59,30 @@
 #define TEST_LIST              const struct test__ test_list__[]
 
 
+/* Macro to turn a unit test into a family of parameterized test cases.
+ * Declaring
+ *
+ *   TEST_PARAMS(test_func, "k", 1, 9);
+ *
+ * next to test_func() and listing it in TEST_LIST as
+ *
+ *   { "test_name", test_func, &test_func_params__ },
+ *
+ * runs it as the cases "test_name/k=1" ... "test_name/k=9". Each case is
+ * selected like any other unit test (so "test_name" selects all of them) and
+ * reads its value with TEST_PARAM().
+ */
+#define TEST_PARAMS(func, label, first, last)                                 \
+    const struct test_params__ func##_params__ = { (label), (first), (last) }
+#define TEST_PARAM()           (test_param__)
+
+/* Name of the running test (case), e.g. "churn/k=1". */
+#define TEST_NAME()            (test_name__)
+
+/* Process ID of the process running the test, not of those it forks. */
+#define TEST_PID()             (test_pid__)
+
+
 /* Macros for testing whether an unit test succeeds or fails. These macros
  * can be used arbitrarily in functions implementing the unit tests.
  *
@@ -77,9 +101,41 @@
  *       TEST_CHECK(ptr->member1 < 100);
  *       TEST_CHECK(ptr->member2 > 200);
  *   }
+ *
+ * A passing condition only bumps a counter unless all conditions are to be
+ * printed (--verbose=3), so the macros are cheap enough for hot loops. The
+ * message arguments are evaluated only when the condition fails or is
+ * printed.
  */
-#define TEST_CHECK_(cond,...)  test_check__((cond), __FILE__, __LINE__, __VA_ARGS__)
-#define TEST_CHECK(cond)       test_check__((cond), __FILE__, __LINE__, "%s", #cond)
+#define TEST_CHECK_(cond,...)  TEST_CHECK_FAST__((cond), test_check__(test_cond__, __FILE__, __LINE__, __VA_ARGS__))
+#define TEST_CHECK(cond)       TEST_CHECK_FAST__((cond), test_check__(test_cond__, __FILE__, __LINE__, "%s", #cond))
+
+#define TEST_CHECK_FAST__(cond, slow)                                         \
+    (((test_cond__ = ((cond) != 0)) != 0  &&  test_fast_checks__)            \
+        ? (test_check_count__++, 1)                                           \
+        : (slow))
+
+
+/* Function called with the location and outcome of every condition checked,
+ * once set, e.g. to record the order of the checks (see golden.c). Set it
+ * before the tests start (from a constructor): passing conditions then all
+ * go through test_check__() rather than just being counted. */
+extern void (*test_check_hook__)(const char* file, int line, int cond);
+
+/* Function called when the test ends, once set, in the test's own process:
+ * with 0 before its verdict is decided, when the test function returns or
+ * the process exits, so that the conditions it checks count; or with the
+ * signal number from the crash handler, where it should only save what it
+ * must (see trace.c). Set it before the tests start, from a constructor. */
+extern void (*test_end_hook__)(int sig);
+
+/* Function returning the running thread, once set. It is called when a
+ * condition first fails and when the test crashes, and what it returns is
+ * shown if the test crashes. It starts as TEST_THREAD_ID, which you may
+ * define prior including "acutest.h" (the runners generated by
+ * assimilate.sh do); runners wrapping it may point it elsewhere from a
+ * constructor. */
+extern int (*test_thread_id__)(void);
 
 
 /* printf-like macro for outputting an extra information about a failure.
@@ -105,6 +161,94 @@
     #define TEST_MSG_MAXSIZE   1024
 #endif
 
+/* Macro for reporting a result of the test, such as a benchmark timing.
+ * Unlike TEST_MSG, results are always printed (unless with --verbose=0),
+ * as lines under the test's verdict when the test ends.
+ *
+ * Sample usage:
+ *
+ *   TEST_RESULT("yield: %.1f ns", ns);
+ */
+#define TEST_RESULT(...)       test_result__(__VA_ARGS__)
+
+/* Macro for checking the performance of the statement that follows it, like
+ * a TEST_CHECK of its cost. The statement is run in batches, grown until a
+ * batch takes TEST_PERF_BATCH_NS, and the fastest of TEST_PERF_REPS batches
+ * gives its cost per iteration. The check fails when that cost exceeds the
+ * budget, which is in calibration units: the time of one step of a loop of
+ * dependent multiply-adds, timed before the first performance check of the
+ * run, so that the budget holds on faster and slower machines alike. Names
+ * are printf formats. TEST_PERF_LAST() is the cost of the last statement
+ * checked, in units, to budget a statement relative to another:
+ *
+ *   TEST_PERF_CHECK(20000, "switch") { MyYieldThread(t); }
+ *   TEST_PERF_CHECK(0.05 * TEST_PERF_LAST(), "self") { MyYieldThread(0); }
+ *
+ * Runners that slow the statement down by instrumenting it set
+ * test_perf_off__ to the reason: the statement then runs once, unchecked.
+ */
+#define TEST_PERF_CHECK(budget, ...)                                          \
+    for(struct test_perf__ test_perf__ =                                      \
+            test_perf_start__((budget), __FILE__, __LINE__, __VA_ARGS__);      \
+        test_perf__.i++ < test_perf__.n  ||  test_perf_batch__(&test_perf__); )
+#define TEST_PERF_LAST()       (test_perf_last__)
+
+/* Duration of the batches of TEST_PERF_CHECK, and how many are timed.
+ * You may define other values prior including "acutest.h"
+ */
+#ifndef TEST_PERF_BATCH_NS
+    #define TEST_PERF_BATCH_NS     10000000   /* 10 ms */
+#endif
+#ifndef TEST_PERF_REPS
+    #define TEST_PERF_REPS         3
+#endif
+
+/* Maximal size of the results of one test. Further results are dropped.
+ * You may define another limit prior including "acutest.h"
+ */
+#ifndef TEST_RESULTS_MAXSIZE
+    #define TEST_RESULTS_MAXSIZE   8192
+#endif
+
+/* Size of the in-memory arena that collects the output of a test (check
+ * results and TEST_MSG text). The arena is written to stdout only when a
+ * condition fails, when the test ends, when the arena fills up, or when the
+ * test crashes, so even verbose runs keep stdio out of the tests' hot loops.
+ * Use --verbose=stream to print everything immediately instead.
+ * You may define another size prior including "acutest.h"
+ */
+#ifndef TEST_LOG_ARENA_SIZE
+    #define TEST_LOG_ARENA_SIZE  (1024 * 1024)
+#endif
+
+/* Sampling rate, backtrace depth, sample buffer size and report length of
+ * --profile (Linux only). Samples beyond the buffer are counted as dropped.
+ * You may define other values prior including "acutest.h"
+ */
+#ifndef TEST_PROF_HZ
+    #define TEST_PROF_HZ           1000
+#endif
+#ifndef TEST_PROF_DEPTH
+    #define TEST_PROF_DEPTH        8
+#endif
+#ifndef TEST_PROF_MAX_SAMPLES
+    #define TEST_PROF_MAX_SAMPLES  65536
+#endif
+#ifndef TEST_PROF_TOP
+    #define TEST_PROF_TOP          15
+#endif
+
+/* Maximal number of --kernel options, and of benchmark results kept for the
+ * side-by-side report, of runners built with -DTEST_KERNELS (see kernels.c).
+ * You may define other values prior including "acutest.h"
+ */
+#ifndef TEST_KERNELS_MAX
+    #define TEST_KERNELS_MAX       8
+#endif
+#ifndef TEST_KERNELS_RESULTS
+    #define TEST_KERNELS_RESULTS   4096
+#endif
+
 
 /**********************
  *** Implementation ***
@@ -116,6 +260,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #if defined(unix) || defined(__unix__) || defined(__unix) || defined(__APPLE__)
     #define ACUTEST_UNIX__      1
@@ -124,12 +269,24 @@
     #include <sys/types.h>
     #include <sys/wait.h>
     #include <signal.h>
+    #include <sys/mman.h>
+    #if defined(TEST_KERNELS)
+        #define ACUTEST_KERNELS__   1
+        #include <math.h>
+    #endif
 #endif
 
 #if defined(__gnu_linux__)
     #define ACUTEST_LINUX__     1
     #include <fcntl.h>
     #include <sys/stat.h>
+    #if defined(__x86_64__) || defined(__aarch64__)
+        #define ACUTEST_PROFILE__   1
+        #include <elf.h>
+        #include <stdint.h>
+        #include <sys/time.h>
+        #include <ucontext.h>
+    #endif
 #endif
 
 #if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
@@ -152,20 +309,57 @@
 #endif
 
 
+struct test_params__ {
+    const char* label;
+    int first;
+    int last;
+};
+
 struct test__ {
     const char* name;
     void (*func)(void);
+    const struct test_params__* params;
+    int param;
 };
 
 extern const struct test__ test_list__[];
 
 int test_check__(int cond, const char* file, int line, const char* fmt, ...);
 void test_message__(const char* fmt, ...);
+void test_result__(const char* fmt, ...);
+
+extern int test_param__;
+extern const char* test_name__;
+extern long test_pid__;
+extern int test_cond__;
+extern int test_fast_checks__;
+extern unsigned long test_check_count__;
+
+struct test_perf__ {
+    char name[64];
+    const char* file;
+    int line;
+    double budget;          /* In calibration units */
+    long long n, i;         /* Iterations of the batch, and the current one */
+    double start;
+    double best;            /* Fastest batch, in seconds */
+    int rep;                /* -1 while sizing the batches */
+};
+
+struct test_perf__ test_perf_start__(double budget, const char* file, int line, const char* fmt, ...)
+#if defined(__GNUC__)
+        __attribute__((format(printf, 4, 5)))
+#endif
+        ;
+int test_perf_batch__(struct test_perf__* perf);
+extern double test_perf_last__;
+extern const char* test_perf_off__;
 
 
 #ifndef TEST_NO_MAIN
 
 static char* test_argv0__ = NULL;
+static struct test__* test_cases__ = NULL;
 static size_t test_list_size__ = 0;
 static const struct test__** tests__ = NULL;
 static char* test_flags__ = NULL;
@@ -178,11 +372,62 @@ static int test_stat_failed_units__ = 0;
 static int test_stat_run_units__ = 0;
 
 static const struct test__* test_current_unit__ = NULL;
+static int test_current_running__ = 0;
+static double test_current_start__ = 0.0;
 static int test_current_already_logged__ = 0;
 static int test_verbose_level__ = 2;
 static int test_current_failures__ = 0;
+static char test_results__[TEST_RESULTS_MAXSIZE];
+static size_t test_results_used__ = 0;
 static int test_colorize__ = 0;
 
+/* Value of the running case of a parameterized test; see TEST_PARAMS. */
+int test_param__ = 0;
+const char* test_name__ = NULL;
+long test_pid__ = 0;
+
+/* State of the TEST_CHECK fast path; see TEST_CHECK_FAST__. */
+int test_cond__ = 0;
+int test_fast_checks__ = 1;
+unsigned long test_check_count__ = 0;
+
+void (*test_check_hook__)(const char* file, int line, int cond) = NULL;
+void (*test_end_hook__)(int sig) = NULL;
+
+#ifndef TEST_THREAD_ID
+    #define TEST_THREAD_ID NULL
+#endif
+int (*test_thread_id__)(void) = TEST_THREAD_ID;
+
+/* Result of the running test. It lives in a page shared with the runner,
+ * which reads it when the child has ended: the child writes it as the test
+ * runs, and its crash handler completes it, so the runner learns how far a
+ * crashed test got, and where it first failed, without parsing its output. */
+struct test_channel__ {
+    unsigned long checks;       /* Conditions checked */
+    int failures;               /* Conditions failed */
+    char file[64];              /* Location of the first failed condition */
+    int line;
+    int thread;                 /* Running thread at the first failure or the crash, or -1 */
+    int finished;               /* The test ended other than by a crash */
+    double start;
+    double seconds;
+};
+static struct test_channel__ test_channel_local__;
+static struct test_channel__* test_channel__ = &test_channel_local__;
+
+/* Totals over all run tests for the summary, added from the channel. */
+struct test_totals__ {
+    unsigned long checks;
+    double seconds;
+};
+static struct test_totals__ test_totals_local__;
+static struct test_totals__* test_totals__ = &test_totals_local__;
+
+static char test_log_arena__[TEST_LOG_ARENA_SIZE];
+static size_t test_log_used__ = 0;
+static int test_log_stream__ = 0;
+
 #define TEST_COLOR_DEFAULT__            0
 #define TEST_COLOR_GREEN__              1
 #define TEST_COLOR_RED__                2
@@ -190,6 +435,571 @@ static int test_colorize__ = 0;
 #define TEST_COLOR_GREEN_INTENSIVE__    4
 #define TEST_COLOR_RED_INTENSIVE__      5
 
+static double
+test_timer_now__(void)
+{
+#if defined(ACUTEST_UNIX__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#elif defined(ACUTEST_WIN__)
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double) now.QuadPart / (double) freq.QuadPart;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Write out everything collected in the log arena so far. */
+static void
+test_log_flush__(void)
+{
+    if(test_log_used__ > 0) {
+        fwrite(test_log_arena__, 1, test_log_used__, stdout);
+        test_log_used__ = 0;
+    }
+    fflush(stdout);
+}
+
+/* vprintf() into the log arena (or straight to stdout with --verbose=stream).
+ * Returns the number of characters the message has, like vprintf(). */
+static int
+test_log_vprintf__(const char* fmt, va_list args)
+{
+    va_list args2;
+    size_t avail;
+    int n;
+
+    if(test_log_stream__)
+        return vprintf(fmt, args);
+
+    va_copy(args2, args);
+    avail = TEST_LOG_ARENA_SIZE - test_log_used__;
+    n = vsnprintf(test_log_arena__ + test_log_used__, avail, fmt, args);
+    if(n >= 0  &&  (size_t) n >= avail) {
+        /* Does not fit. Make room and retry; the message gets cut only if it
+         * is larger than the whole arena. */
+        test_log_flush__();
+        avail = TEST_LOG_ARENA_SIZE;
+        n = vsnprintf(test_log_arena__, avail, fmt, args2);
+    }
+    va_end(args2);
+
+    if(n > 0)
+        test_log_used__ += ((size_t) n < avail) ? (size_t) n : avail - 1;
+    return n;
+}
+
+static int
+test_log_printf__(const char* fmt, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = test_log_vprintf__(fmt, args);
+    va_end(args);
+    return n;
+}
+
+#if defined(ACUTEST_UNIX__)
+/* Crash handler of the test: dump the arena with plain write() so nothing
+ * logged before the crash is lost, complete the channel, then die by the
+ * same signal. It runs on its own stack, since the crash may be an overflow
+ * of a thread's stack. The running thread is asked for last, as the kernel
+ * may be what crashed. */
+static char test_log_crash_stack__[16384];
+
+static void
+test_log_crash__(int sig)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    while(off < test_log_used__) {
+        n = write(STDOUT_FILENO, test_log_arena__ + off, test_log_used__ - off);
+        if(n <= 0)
+            break;
+        off += (size_t) n;
+    }
+    test_log_used__ = 0;
+
+    /* Only the test's own process reports, not those it forks. */
+    if((long) getpid() == test_pid__) {
+        if(test_end_hook__ != NULL  &&  test_current_running__)
+            test_end_hook__(sig);
+        test_channel__->checks = test_check_count__;
+        test_channel__->seconds = test_timer_now__() - test_channel__->start;
+        if(test_thread_id__ != NULL)
+            test_channel__->thread = test_thread_id__();
+    }
+
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void
+test_log_install_crash_handler__(void)
+{
+    static const int sigs[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    struct sigaction sa;
+    stack_t ss;
+    size_t i;
+
+    ss.ss_sp = test_log_crash_stack__;
+    ss.ss_size = sizeof(test_log_crash_stack__);
+    ss.ss_flags = 0;
+    sigaltstack(&ss, NULL);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = test_log_crash__;
+    sa.sa_flags = SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    for(i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i++)
+        sigaction(sigs[i], &sa, NULL);
+}
+#endif
+
+#if defined(ACUTEST_PROFILE__)
+/* Sampling profiler of --profile. While a test runs, ITIMER_PROF delivers
+ * SIGPROF every 1/TEST_PROF_HZ s of CPU time, and the handler stores the
+ * interrupted PC and the return addresses found by following the frame
+ * pointers from the interrupted registers. So a sample taken on a thread's
+ * own stack is unwound on that stack, whichever stack the kernel switched
+ * to. The handler only writes to the preallocated buffer; the addresses are
+ * resolved to functions when the test ends, from /proc/self/maps and the
+ * symbol tables of the mapped ELF files. */
+#define TEST_PROF_SPAN__        (256 * 1024)  /* Longest frame chain on one stack */
+#define TEST_PROF_MAX_OBJS__    64
+#define TEST_PROF_MAX_MAPS__    256
+#define TEST_PROF_MAX_FUNCS__   1024
+#define TEST_PROF_CACHE_SIZE__  4096          /* Power of two */
+
+static int test_profile__ = 0;
+static uintptr_t* test_prof_buf__ = NULL;
+static volatile size_t test_prof_count__ = 0;
+static volatile size_t test_prof_dropped__ = 0;
+
+/* Whether the word pair at fp can be read. mincore() fails on unmapped
+ * pages, so a frame pointer register holding some other value cannot crash
+ * the handler. */
+static int
+test_prof_readable__(uintptr_t fp, uintptr_t* page)
+{
+    uintptr_t first = fp & ~(uintptr_t) 4095;
+    uintptr_t last = (fp + 2 * sizeof(uintptr_t) - 1) & ~(uintptr_t) 4095;
+    unsigned char vec[2];
+
+    if(first == *page && last == *page)
+        return 1;
+    if(mincore((void*) first, last - first + 4096, vec) != 0)
+        return 0;
+    *page = last;
+    return 1;
+}
+
+static void
+test_prof_handler__(int sig, siginfo_t* info, void* context)
+{
+    const ucontext_t* uc = (const ucontext_t*) context;
+    uintptr_t pc, sp, fp, next, page = 0;
+    uintptr_t* sample;
+    int n = 0;
+    int saved_errno = errno;
+
+    (void) sig;
+    (void) info;
+    if(test_prof_count__ >= TEST_PROF_MAX_SAMPLES) {
+        test_prof_dropped__++;
+        return;
+    }
+
+#if defined(__x86_64__)
+    pc = (uintptr_t) uc->uc_mcontext.gregs[16];   /* REG_RIP */
+    sp = (uintptr_t) uc->uc_mcontext.gregs[15];   /* REG_RSP */
+    fp = (uintptr_t) uc->uc_mcontext.gregs[10];   /* REG_RBP */
+#else
+    pc = (uintptr_t) uc->uc_mcontext.pc;
+    sp = (uintptr_t) uc->uc_mcontext.sp;
+    fp = (uintptr_t) uc->uc_mcontext.regs[29];
+#endif
+
+    sample = test_prof_buf__ + test_prof_count__ * TEST_PROF_DEPTH;
+    sample[n++] = pc;
+    /* Each frame record is { caller's fp, return address }. Stop as soon as
+     * the chain leaves the interrupted stack or stops growing upwards. */
+    while(n < TEST_PROF_DEPTH  &&  fp >= sp  &&  fp - sp < TEST_PROF_SPAN__  &&
+          (fp & (sizeof(uintptr_t) - 1)) == 0  &&  test_prof_readable__(fp, &page)) {
+        next = ((uintptr_t*) fp)[0];
+        sample[n++] = ((uintptr_t*) fp)[1];
+        if(next <= fp)
+            break;
+        fp = next;
+    }
+    if(n < TEST_PROF_DEPTH)
+        sample[n] = 0;
+    test_prof_count__++;
+    errno = saved_errno;
+}
+
+static void
+test_prof_start__(void)
+{
+    struct sigaction sa;
+    struct itimerval it;
+    stack_t ss;
+
+    if(test_prof_buf__ == NULL) {
+        test_prof_buf__ = (uintptr_t*) malloc(sizeof(uintptr_t) * TEST_PROF_DEPTH * TEST_PROF_MAX_SAMPLES);
+        if(test_prof_buf__ == NULL) {
+            fprintf(stderr, "Cannot allocate the profile buffer.\n");
+            return;
+        }
+    }
+    test_prof_count__ = 0;
+    test_prof_dropped__ = 0;
+
+    /* A thread's stack may have little room left when the signal arrives */
+    ss.ss_sp = test_log_crash_stack__;
+    ss.ss_size = sizeof(test_log_crash_stack__);
+    ss.ss_flags = 0;
+    sigaltstack(&ss, NULL);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = test_prof_handler__;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+
+    it.it_interval.tv_sec = 0;
+    it.it_interval.tv_usec = 1000000 / TEST_PROF_HZ;
+    it.it_value = it.it_interval;
+    setitimer(ITIMER_PROF, &it, NULL);
+}
+
+static void
+test_prof_stop__(void)
+{
+    struct itimerval it;
+
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+    signal(SIGPROF, SIG_IGN);
+}
+
+/* An ELF file mapped into the process, mapped once more for its symbols */
+struct test_prof_obj__ {
+    char path[256];
+    const char* name;           /* Base name of the path */
+    const unsigned char* image;
+    const Elf64_Phdr* phdrs;
+    size_t phnum;
+    const Elf64_Sym* syms;
+    size_t nsyms;
+    const char* strs;
+};
+
+/* An executable mapping of /proc/self/maps */
+struct test_prof_map__ {
+    uintptr_t start;
+    uintptr_t end;
+    uintptr_t offset;
+    int obj;
+};
+
+struct test_prof_func__ {
+    const char* name;
+    const char* where;
+    size_t self;
+    size_t total;
+    size_t last;                /* Last sample counted in total, plus one */
+};
+
+static struct test_prof_obj__ test_prof_objs__[TEST_PROF_MAX_OBJS__];
+static int test_prof_nobjs__ = 0;
+static struct test_prof_map__ test_prof_maps__[TEST_PROF_MAX_MAPS__];
+static int test_prof_nmaps__ = 0;
+static struct test_prof_func__ test_prof_funcs__[TEST_PROF_MAX_FUNCS__];
+static int test_prof_nfuncs__ = 0;
+static struct { uintptr_t addr; int func; } test_prof_cache__[TEST_PROF_CACHE_SIZE__];
+
+static void
+test_prof_load_obj__(struct test_prof_obj__* obj)
+{
+    const Elf64_Ehdr* eh;
+    const Elf64_Shdr* sh;
+    struct stat st;
+    void* image;
+    size_t i;
+    int fd, pass;
+
+    fd = open(obj->path, O_RDONLY);
+    if(fd < 0)
+        return;
+    if(fstat(fd, &st) != 0  ||  (size_t) st.st_size < sizeof(Elf64_Ehdr)) {
+        close(fd);
+        return;
+    }
+    image = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(image == MAP_FAILED)
+        return;
+
+    eh = (const Elf64_Ehdr*) image;
+    if(memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0  ||  eh->e_ident[EI_CLASS] != ELFCLASS64  ||
+       eh->e_phoff + (size_t) eh->e_phnum * sizeof(Elf64_Phdr) > (size_t) st.st_size  ||
+       eh->e_shoff + (size_t) eh->e_shnum * sizeof(Elf64_Shdr) > (size_t) st.st_size) {
+        munmap(image, (size_t) st.st_size);
+        return;
+    }
+    obj->image = (const unsigned char*) image;
+    obj->phdrs = (const Elf64_Phdr*) (obj->image + eh->e_phoff);
+    obj->phnum = eh->e_phnum;
+
+    /* Prefer the full symbol table; stripped libraries only have .dynsym */
+    sh = (const Elf64_Shdr*) (obj->image + eh->e_shoff);
+    for(pass = 0; pass < 2  &&  obj->syms == NULL; pass++) {
+        for(i = 0; i < eh->e_shnum; i++) {
+            if(sh[i].sh_type != (pass == 0 ? SHT_SYMTAB : SHT_DYNSYM)  ||  sh[i].sh_link >= eh->e_shnum)
+                continue;
+            if(sh[i].sh_offset + sh[i].sh_size > (size_t) st.st_size  ||
+               sh[sh[i].sh_link].sh_offset + sh[sh[i].sh_link].sh_size > (size_t) st.st_size)
+                continue;
+            obj->syms = (const Elf64_Sym*) (obj->image + sh[i].sh_offset);
+            obj->nsyms = sh[i].sh_size / sizeof(Elf64_Sym);
+            obj->strs = (const char*) (obj->image + sh[sh[i].sh_link].sh_offset);
+            break;
+        }
+    }
+}
+
+static void
+test_prof_load_maps__(void)
+{
+    char line[512];
+    char perms[8];
+    unsigned long start, end, offset;
+    int pos, i;
+    FILE* f;
+
+    if(test_prof_nmaps__ > 0)
+        return;
+    f = fopen("/proc/self/maps", "r");
+    if(f == NULL)
+        return;
+    while(fgets(line, sizeof(line), f) != NULL  &&  test_prof_nmaps__ < TEST_PROF_MAX_MAPS__) {
+        char* path;
+        char* end_of_path;
+
+        if(sscanf(line, "%lx-%lx %7s %lx %*s %*s %n", &start, &end, perms, &offset, &pos) < 4)
+            continue;
+        path = line + pos;
+        end_of_path = strchr(path, '\n');
+        if(end_of_path != NULL)
+            *end_of_path = '\0';
+        if(perms[2] != 'x'  ||  path[0] != '/')
+            continue;
+
+        for(i = 0; i < test_prof_nobjs__; i++) {
+            if(strcmp(test_prof_objs__[i].path, path) == 0)
+                break;
+        }
+        if(i == test_prof_nobjs__) {
+            struct test_prof_obj__* obj;
+            const char* slash;
+
+            if(test_prof_nobjs__ == TEST_PROF_MAX_OBJS__)
+                continue;
+            obj = &test_prof_objs__[test_prof_nobjs__++];
+            snprintf(obj->path, sizeof(obj->path), "%s", path);
+            slash = strrchr(obj->path, '/');
+            obj->name = (slash != NULL) ? slash + 1 : obj->path;
+            test_prof_load_obj__(obj);
+        }
+
+        test_prof_maps__[test_prof_nmaps__].start = start;
+        test_prof_maps__[test_prof_nmaps__].end = end;
+        test_prof_maps__[test_prof_nmaps__].offset = offset;
+        test_prof_maps__[test_prof_nmaps__].obj = i;
+        test_prof_nmaps__++;
+    }
+    fclose(f);
+}
+
+/* Name of the source file of symbol sym, from the STT_FILE symbol that
+ * precedes the local symbols of each file in .symtab. Global symbols are
+ * listed apart from their file, so they are attributed to the file of the
+ * closest local function below them (compilers emit a file's functions
+ * together). Falls back to the object's name. */
+static const char*
+test_prof_where__(const struct test_prof_obj__* obj, size_t sym)
+{
+    const Elf64_Sym* s = obj->syms;
+    size_t i, best = sym;
+
+    if(ELF64_ST_BIND(s[sym].st_info) != STB_LOCAL) {
+        best = obj->nsyms;
+        for(i = 0; i < obj->nsyms; i++) {
+            if(ELF64_ST_BIND(s[i].st_info) != STB_LOCAL  ||  ELF64_ST_TYPE(s[i].st_info) != STT_FUNC  ||
+               s[i].st_value == 0  ||  s[i].st_value > s[sym].st_value)
+                continue;
+            if(best == obj->nsyms  ||  s[i].st_value > s[best].st_value)
+                best = i;
+        }
+        if(best == obj->nsyms)
+            return obj->name;
+    }
+    for(i = best; i > 0; i--) {
+        if(ELF64_ST_TYPE(s[i - 1].st_info) == STT_FILE)
+            return obj->strs + s[i - 1].st_name;
+    }
+    return obj->name;
+}
+
+/* Index of the function containing addr in test_prof_funcs__, or -1 */
+static int
+test_prof_lookup__(uintptr_t addr)
+{
+    const struct test_prof_obj__* obj = NULL;
+    const char* name = "??";
+    const char* where = "?";
+    uintptr_t vaddr = 0;
+    size_t i, best;
+    int m, f;
+    unsigned h = (unsigned) ((addr >> 2) * 2654435761u) & (TEST_PROF_CACHE_SIZE__ - 1);
+
+    while(test_prof_cache__[h].addr != 0) {
+        if(test_prof_cache__[h].addr == addr)
+            return test_prof_cache__[h].func;
+        h = (h + 1) & (TEST_PROF_CACHE_SIZE__ - 1);
+    }
+
+    for(m = 0; m < test_prof_nmaps__; m++) {
+        if(addr >= test_prof_maps__[m].start  &&  addr < test_prof_maps__[m].end) {
+            obj = &test_prof_objs__[test_prof_maps__[m].obj];
+            where = obj->name;
+            break;
+        }
+    }
+
+    /* File offset to the virtual address of the symbol tables */
+    if(obj != NULL  &&  obj->image != NULL) {
+        uintptr_t offset = addr - test_prof_maps__[m].start + test_prof_maps__[m].offset;
+        for(i = 0; i < obj->phnum; i++) {
+            const Elf64_Phdr* ph = &obj->phdrs[i];
+            if(ph->p_type == PT_LOAD  &&  offset >= ph->p_offset  &&  offset < ph->p_offset + ph->p_filesz) {
+                vaddr = ph->p_vaddr + (offset - ph->p_offset);
+                break;
+            }
+        }
+        best = obj->nsyms;
+        for(i = 0; vaddr != 0  &&  i < obj->nsyms; i++) {
+            const Elf64_Sym* s = &obj->syms[i];
+            int type = ELF64_ST_TYPE(s->st_info);
+            if((type != STT_FUNC && type != STT_GNU_IFUNC)  ||  s->st_shndx == SHN_UNDEF  ||  s->st_value > vaddr)
+                continue;
+            if(s->st_size != 0 && vaddr >= s->st_value + s->st_size)
+                continue;
+            if(best == obj->nsyms  ||  s->st_value > obj->syms[best].st_value)
+                best = i;
+        }
+        if(best < obj->nsyms) {
+            name = obj->strs + obj->syms[best].st_name;
+            where = test_prof_where__(obj, best);
+        }
+    }
+
+    for(f = 0; f < test_prof_nfuncs__; f++) {
+        if(strcmp(test_prof_funcs__[f].name, name) == 0  &&  strcmp(test_prof_funcs__[f].where, where) == 0)
+            break;
+    }
+    if(f == test_prof_nfuncs__) {
+        if(f == TEST_PROF_MAX_FUNCS__) {
+            f = -1;
+        } else {
+            memset(&test_prof_funcs__[f], 0, sizeof(test_prof_funcs__[f]));
+            test_prof_funcs__[f].name = name;
+            test_prof_funcs__[f].where = where;
+            test_prof_nfuncs__++;
+        }
+    }
+
+    test_prof_cache__[h].addr = addr;
+    test_prof_cache__[h].func = f;
+    return f;
+}
+
+static int
+test_prof_cmp__(const void* a, const void* b)
+{
+    const struct test_prof_func__* fa = &test_prof_funcs__[*(const int*) a];
+    const struct test_prof_func__* fb = &test_prof_funcs__[*(const int*) b];
+
+    if(fa->self != fb->self)
+        return (fa->self < fb->self) ? 1 : -1;
+    if(fa->total != fb->total)
+        return (fa->total < fb->total) ? 1 : -1;
+    return 0;
+}
+
+/* Print the flat profile of the test: for the functions with the most
+ * samples, the share of samples in the function itself (self) and with the
+ * function anywhere on the sampled backtrace (total). */
+static void
+test_prof_report__(void)
+{
+    int order[TEST_PROF_MAX_FUNCS__];
+    size_t count = test_prof_count__;
+    size_t i;
+    int j, f;
+
+    test_prof_load_maps__();
+    for(f = 0; f < test_prof_nfuncs__; f++) {
+        test_prof_funcs__[f].self = 0;
+        test_prof_funcs__[f].total = 0;
+        test_prof_funcs__[f].last = 0;
+    }
+
+    for(i = 0; i < count; i++) {
+        const uintptr_t* sample = test_prof_buf__ + i * TEST_PROF_DEPTH;
+        for(j = 0; j < TEST_PROF_DEPTH  &&  sample[j] != 0; j++) {
+            /* Return addresses may already be past the end of the caller */
+            f = test_prof_lookup__(j == 0 ? sample[j] : sample[j] - 1);
+            if(f < 0)
+                continue;
+            if(j == 0)
+                test_prof_funcs__[f].self++;
+            if(test_prof_funcs__[f].last != i + 1) {
+                test_prof_funcs__[f].total++;
+                test_prof_funcs__[f].last = i + 1;
+            }
+        }
+    }
+
+    /* The kernel may deliver the timer at its tick rate below TEST_PROF_HZ,
+     * so only the shares are meaningful, not the sample count. */
+    test_log_printf__("  Profile: %lu samples", (unsigned long) count);
+    if(test_prof_dropped__ > 0)
+        test_log_printf__(", %lu dropped", (unsigned long) test_prof_dropped__);
+    test_log_printf__("\n");
+    if(count == 0)
+        return;
+
+    for(f = 0; f < test_prof_nfuncs__; f++)
+        order[f] = f;
+    qsort(order, (size_t) test_prof_nfuncs__, sizeof(order[0]), test_prof_cmp__);
+    test_log_printf__("    %6s %6s  %s\n", "self", "total", "function");
+    for(j = 0; j < test_prof_nfuncs__  &&  j < TEST_PROF_TOP; j++) {
+        const struct test_prof_func__* fn = &test_prof_funcs__[order[j]];
+        test_log_printf__("    %5.1f%% %5.1f%%  %s (%s)\n",
+                100.0 * (double) fn->self / (double) count,
+                100.0 * (double) fn->total / (double) count, fn->name, fn->where);
+    }
+}
+#endif
+
 static int
 test_print_in_color__(int color, const char* fmt, ...)
 {
@@ -203,7 +1013,7 @@ test_print_in_color__(int color, const char* fmt, ...)
     buffer[sizeof(buffer)-1] = '\0';
 
     if(!test_colorize__) {
-        return printf("%s", buffer);
+        return test_log_printf__("%s", buffer);
     }
 
 #if defined ACUTEST_UNIX__
@@ -217,9 +1027,9 @@ test_print_in_color__(int color, const char* fmt, ...)
             case TEST_COLOR_DEFAULT_INTENSIVE__: col_str = "\033[1m"; break;
             default:                                col_str = "\033[0m"; break;
         }
-        printf("%s", col_str);
-        n = printf("%s", buffer);
-        printf("\033[0m");
+        test_log_printf__("%s", col_str);
+        n = test_log_printf__("%s", buffer);
+        test_log_printf__("\033[0m");
         return n;
     }
 #elif defined ACUTEST_WIN__
@@ -228,6 +1038,8 @@ test_print_in_color__(int color, const char* fmt, ...)
         CONSOLE_SCREEN_BUFFER_INFO info;
         WORD attr;
 
+        /* Console attributes apply to what is printed from now on. */
+        test_log_flush__();
         h = GetStdHandle(STD_OUTPUT_HANDLE);
         GetConsoleScreenBufferInfo(h, &info);
 
@@ -246,7 +1058,7 @@ test_print_in_color__(int color, const char* fmt, ...)
         return n;
     }
 #else
-    n = printf("%s", buffer);
+    n = test_log_printf__("%s", buffer);
     return n;
 #endif
 }
@@ -258,27 +1070,40 @@ test_check__(int cond, const char* file, int line, const char* fmt, ...)
     int result_color;
     int verbose_level;
 
+    test_check_count__++;
+    if(test_check_hook__ != NULL)
+        test_check_hook__(file, line, cond);
+
     if(cond) {
         result_str = "ok";
         result_color = TEST_COLOR_GREEN__;
         verbose_level = 3;
     } else {
         if(!test_current_already_logged__  &&  test_current_unit__ != NULL) {
-            printf("[ ");
+            test_log_printf__("[ ");
             test_print_in_color__(TEST_COLOR_RED_INTENSIVE__, "FAILED");
-            printf(" ]\n");
+            test_log_printf__(" ]\n");
         }
         result_str = "failed";
         result_color = TEST_COLOR_RED__;
         verbose_level = 2;
         test_current_failures__++;
         test_current_already_logged__++;
+
+        test_channel__->checks = test_check_count__;
+        if(test_channel__->failures++ == 0) {
+            snprintf(test_channel__->file, sizeof(test_channel__->file), "%s",
+                     file != NULL ? file : "");
+            test_channel__->line = line;
+            if(test_thread_id__ != NULL)
+                test_channel__->thread = test_thread_id__();
+        }
     }
 
     if(test_verbose_level__ >= verbose_level) {
         va_list args;
 
-        printf("  ");
+        test_log_printf__("  ");
 
         if(file != NULL) {
             if(test_verbose_level__ < 3) {
@@ -296,19 +1121,22 @@ test_check__(int cond, const char* file, int line, const char* fmt, ...)
                     file = lastsep+1;
 #endif
             }
-            printf("%s:%d: Check ", file, line);
+            test_log_printf__("%s:%d: Check ", file, line);
         }
 
         va_start(args, fmt);
-        vprintf(fmt, args);
+        test_log_vprintf__(fmt, args);
         va_end(args);
 
-        printf("... ");
+        test_log_printf__("... ");
         test_print_in_color__(result_color, result_str);
-        printf("\n");
+        test_log_printf__("\n");
         test_current_already_logged__++;
     }
 
+    if(!cond)
+        test_log_flush__();
+
     return (cond != 0);
 }
 
@@ -338,11 +1166,214 @@ test_message__(const char* fmt, ...)
         line_end = strchr(line_beg, '\n');
         if(line_end == NULL)
             break;
-        printf("    %.*s\n", (int)(line_end - line_beg), line_beg);
+        test_log_printf__("    %.*s\n", (int)(line_end - line_beg), line_beg);
         line_beg = line_end + 1;
     }
     if(line_beg[0] != '\0')
-        printf("    %s\n", line_beg);
+        test_log_printf__("    %s\n", line_beg);
+}
+
+void
+test_result__(const char* fmt, ...)
+{
+    size_t room = sizeof(test_results__) - test_results_used__;
+    va_list args;
+    int n;
+
+    if(test_current_unit__ == NULL || room < 2)
+        return;
+
+    va_start(args, fmt);
+    n = vsnprintf(test_results__ + test_results_used__, room - 1, fmt, args);
+    va_end(args);
+    if(n < 0)
+        return;
+    if((size_t) n >= room - 1)
+        n = (int) room - 2;
+    test_results_used__ += n;
+    test_results__[test_results_used__++] = '\n';
+}
+
+/* Time of one step of the calibration loop of TEST_PERF_CHECK in ns, or 0
+ * until the first performance check. */
+static double test_perf_unit__ = 0.0;
+static volatile unsigned long long test_perf_sink__;
+
+double test_perf_last__ = 0.0;
+const char* test_perf_off__ = NULL;
+
+/* Run n steps of the calibration loop. Returns the time taken in seconds. */
+static double
+test_perf_loop__(long long n)
+{
+    unsigned long long x = test_perf_sink__;
+    double start = test_timer_now__();
+    long long i;
+
+    for(i = 0; i < n; i++) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+#if defined(__GNUC__)
+        __asm__ volatile("" : "+r"(x));
+#endif
+    }
+    test_perf_sink__ = x;
+    return test_timer_now__() - start;
+}
+
+static void
+test_perf_calibrate__(void)
+{
+    long long n = 1024;
+    double best, elapsed;
+    int rep;
+
+    /* Double the loop until it takes a batch, then keep the fastest run */
+    while((best = test_perf_loop__(n)) < TEST_PERF_BATCH_NS * 1e-9)
+        n *= 2;
+    for(rep = 0; rep < TEST_PERF_REPS; rep++) {
+        elapsed = test_perf_loop__(n);
+        if(elapsed < best)
+            best = elapsed;
+    }
+    test_perf_unit__ = best / (double) n * 1e9;
+}
+
+struct test_perf__
+test_perf_start__(double budget, const char* file, int line, const char* fmt, ...)
+{
+    struct test_perf__ perf;
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(perf.name, sizeof(perf.name), fmt, args);
+    va_end(args);
+    perf.file = file;
+    perf.line = line;
+    perf.budget = budget;
+    perf.n = 1;
+    perf.i = 0;
+    perf.best = 0.0;
+    perf.rep = -1;
+    if(test_perf_off__ == NULL  &&  test_perf_unit__ == 0.0)
+        test_perf_calibrate__();
+    perf.start = test_timer_now__();
+    return perf;
+}
+
+/* A batch of TEST_PERF_CHECK is over: grow it, time it, or check the cost.
+ * Returns 0 when done. */
+int
+test_perf_batch__(struct test_perf__* perf)
+{
+    double elapsed = test_timer_now__() - perf->start;
+    double ns, units;
+
+    if(test_perf_off__ != NULL) {
+        test_result__("perf %s: not checked, as %s", perf->name, test_perf_off__);
+        return 0;
+    }
+
+    if(perf->rep < 0) {
+        if(elapsed < TEST_PERF_BATCH_NS * 1e-9) {
+            /* Aim 20% past the target, growing at most 100x at a time */
+            long long want = (elapsed > 0.0)
+                    ? (long long) (perf->n * (TEST_PERF_BATCH_NS * 1.2e-9) / elapsed)
+                    : perf->n * 100;
+            perf->n = (want > perf->n * 100) ? perf->n * 100 : (want > perf->n) ? want : perf->n + 1;
+        } else {
+            perf->rep = 0;
+        }
+    } else {
+        if(perf->rep == 0  ||  elapsed < perf->best)
+            perf->best = elapsed;
+        if(++perf->rep == TEST_PERF_REPS) {
+            ns = perf->best / (double) perf->n * 1e9;
+            units = ns / test_perf_unit__;
+            test_perf_last__ = units;
+            test_check__(units <= perf->budget, perf->file, perf->line,
+                    "%s: %.2f units (%.1f ns) per iteration, budget %.2f units (%.1f ns)",
+                    perf->name, units, ns, perf->budget, perf->budget * test_perf_unit__);
+            return 0;
+        }
+    }
+
+    perf->i = 1;
+    perf->start = test_timer_now__();
+    return 1;
+}
+
+/* Print the results of the current test, one indented line each. */
+static void
+test_print_results__(void)
+{
+    size_t i = 0;
+    char* line_end;
+
+    while(i < test_results_used__) {
+        line_end = (char*) memchr(test_results__ + i, '\n', test_results_used__ - i);
+        test_log_printf__("  %.*s\n", (int)(line_end - (test_results__ + i)), test_results__ + i);
+        i = (size_t)(line_end - test_results__) + 1;
+    }
+    test_results_used__ = 0;
+}
+
+/* Build test_cases__ from test_list__, with one entry per case of each
+ * parameterized test (named "test_name/label=value"). */
+static void
+test_expand_list__(void)
+{
+    const struct test__* test;
+    struct test__* tcase;
+    char name[256];
+    int value;
+
+    test_list_size__ = 0;
+    for(test = &test_list__[0]; test->func != NULL; test++) {
+        if(test->params == NULL)
+            test_list_size__++;
+        else if(test->params->last >= test->params->first)
+            test_list_size__ += (size_t) (test->params->last - test->params->first + 1);
+    }
+
+    test_cases__ = (struct test__*) calloc(test_list_size__ + 1, sizeof(struct test__));
+    if(test_cases__ == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(2);
+    }
+
+    tcase = test_cases__;
+    for(test = &test_list__[0]; test->func != NULL; test++) {
+        if(test->params == NULL) {
+            *tcase++ = *test;
+            continue;
+        }
+        for(value = test->params->first; value <= test->params->last; value++) {
+            snprintf(name, sizeof(name), "%s/%s=%d", test->name, test->params->label, value);
+            name[sizeof(name)-1] = '\0';
+            *tcase = *test;
+            tcase->name = (char*) malloc(strlen(name) + 1);
+            if(tcase->name == NULL) {
+                fprintf(stderr, "Out of memory.\n");
+                exit(2);
+            }
+            strcpy((char*) tcase->name, name);
+            tcase->param = value;
+            tcase++;
+        }
+    }
+}
+
+static void
+test_free_list__(void)
+{
+    struct test__* tcase;
+
+    for(tcase = test_cases__; tcase->func != NULL; tcase++) {
+        if(tcase->params != NULL)
+            free((void*) tcase->name);
+    }
+    free((void*) test_cases__);
+    test_cases__ = NULL;
 }
 
 static void
@@ -351,7 +1382,7 @@ test_list_names__(void)
     const struct test__* test;
 
     printf("Unit tests:\n");
-    for(test = &test_list__[0]; test->func != NULL; test++)
+    for(test = &test_cases__[0]; test->func != NULL; test++)
         printf("  %s\n", test->name);
 }
 
@@ -363,14 +1394,14 @@ test_remember__(int i)
     else
         test_flags__[i] = 1;
 
-    tests__[test_count__] = &test_list__[i];
+    tests__[test_count__] = &test_cases__[i];
     test_count__++;
 }
 
 static int
 test_name_contains_word__(const char* name, const char* pattern)
 {
-    static const char word_delim[] = " \t-_.";
+    static const char word_delim[] = " \t-_./=";
     const char* substr;
     size_t pattern_len;
     int starts_on_word_boundary;
@@ -400,7 +1431,7 @@ test_lookup__(const char* pattern)
 
     /* Try exact match. */
     for(i = 0; i < (int) test_list_size__; i++) {
-        if(strcmp(test_list__[i].name, pattern) == 0) {
+        if(strcmp(test_cases__[i].name, pattern) == 0) {
             test_remember__(i);
             n++;
             break;
@@ -411,7 +1442,7 @@ test_lookup__(const char* pattern)
 
     /* Try word match. */
     for(i = 0; i < (int) test_list_size__; i++) {
-        if(test_name_contains_word__(test_list__[i].name, pattern)) {
+        if(test_name_contains_word__(test_cases__[i].name, pattern)) {
             test_remember__(i);
             n++;
         }
@@ -421,7 +1452,7 @@ test_lookup__(const char* pattern)
 
     /* Try relaxed match. */
     for(i = 0; i < (int) test_list_size__; i++) {
-        if(strstr(test_list__[i].name, pattern) != NULL) {
+        if(strstr(test_cases__[i].name, pattern) != NULL) {
             test_remember__(i);
             n++;
         }
@@ -430,6 +1461,165 @@ test_lookup__(const char* pattern)
     return n;
 }
 
+#if defined(ACUTEST_KERNELS__)
+/* Runners built with -DTEST_KERNELS call the kernel API through kernels.c,
+ * which loads kernels at run time. Each test is run once with each kernel
+ * given with --kernel, always in a child process, and the output ends with
+ * the verdicts and the benchmark results ("bench NAME: X ns/op" lines, see
+ * benchmarks/bench.h) of all kernels side by side. The children save their
+ * benchmark results in a shared mapping for that. */
+int test_kernel_load__(int k, const char* spec);
+void test_kernel_use__(int k);
+
+struct test_kernel_result__ {
+    int run;                    /* Index into test_kernel_runs__ */
+    char name[60];
+    double ns;
+};
+
+struct test_kernel_shared__ {
+    int used;
+    struct test_kernel_result__ results[TEST_KERNELS_RESULTS];
+};
+
+struct test_kernel_run__ {
+    const struct test__* test;
+    int kernel;
+    int failed;
+};
+
+static char test_kernel_labels__[TEST_KERNELS_MAX][16];
+static int test_kernel_count__ = 0;
+static int test_kernel_current__ = 0;
+static struct test_kernel_run__* test_kernel_runs__ = NULL;
+static int test_kernel_run_count__ = 0;
+static struct test_kernel_shared__* test_kernel_shared__ = NULL;
+
+/* Load the kernel of option --kernel=spec; its label is the file name
+ * without ".so". */
+static int
+test_kernel_add__(const char* spec)
+{
+    const char* base = strrchr(spec, '/');
+    char* label = test_kernel_labels__[test_kernel_count__];
+    size_t len;
+
+    if(test_kernel_count__ == TEST_KERNELS_MAX) {
+        fprintf(stderr, "At most %d kernels can be given.\n", TEST_KERNELS_MAX);
+        return -1;
+    }
+    if(test_kernel_load__(test_kernel_count__, spec) != 0)
+        return -1;
+
+    base = (base != NULL) ? base + 1 : spec;
+    len = strlen(base);
+    if(len > 3 && strcmp(base + len - 3, ".so") == 0)
+        len -= 3;
+    if(len > sizeof(test_kernel_labels__[0]) - 1)
+        len = sizeof(test_kernel_labels__[0]) - 1;
+    memcpy(label, base, len);
+    label[len] = '\0';
+    test_kernel_count__++;
+    return 0;
+}
+
+/* In the child: save the benchmark results of the current test. */
+static void
+test_kernel_save_results__(void)
+{
+    struct test_kernel_shared__* shared = test_kernel_shared__;
+    size_t i = 0;
+    char* line_end;
+
+    if(shared == NULL)
+        return;
+    while(i < test_results_used__ && shared->used < TEST_KERNELS_RESULTS) {
+        struct test_kernel_result__* r = &shared->results[shared->used];
+        const char* line = test_results__ + i;
+
+        line_end = (char*) memchr(line, '\n', test_results_used__ - i);
+        if(strncmp(line, "bench ", 6) == 0  &&
+           sscanf(line, "bench %59[^:\n]: %lf", r->name, &r->ns) == 2) {
+            r->run = test_kernel_run_count__;
+            shared->used++;
+        }
+        i = (size_t)(line_end - test_results__) + 1;
+    }
+}
+#endif
+
+/* Report the result of the current test. This is called when the test unit
+ * function returns, or at exit when the kernel ends the process through
+ * Exit() after the last thread exits. */
+static void
+test_finish__(void)
+{
+    double elapsed;
+
+    if(!test_current_running__)
+        return;
+    if(test_end_hook__ != NULL)
+        test_end_hook__(0);
+    test_current_running__ = 0;
+
+    elapsed = test_timer_now__() - test_current_start__;
+#if defined(ACUTEST_PROFILE__)
+    if(test_profile__)
+        test_prof_stop__();
+#endif
+    test_channel__->checks = test_check_count__;
+    test_channel__->seconds = elapsed;
+    test_channel__->finished = 1;
+#if defined(ACUTEST_KERNELS__)
+    test_kernel_save_results__();
+#endif
+
+    if(test_verbose_level__ >= 3) {
+        test_print_results__();
+        test_log_printf__("  %lu conditions checked in %.3f s (%.0f per second).\n",
+                test_check_count__, elapsed,
+                (elapsed > 0.0) ? (double) test_check_count__ / elapsed : 0.0);
+        switch(test_current_failures__) {
+            case 0:  test_print_in_color__(TEST_COLOR_GREEN_INTENSIVE__, "  All conditions have passed.\n\n"); break;
+            case 1:  test_print_in_color__(TEST_COLOR_RED_INTENSIVE__, "  One condition has FAILED.\n\n"); break;
+            default: test_print_in_color__(TEST_COLOR_RED_INTENSIVE__, "  %d conditions have FAILED.\n\n", test_current_failures__); break;
+        }
+    } else if(test_verbose_level__ >= 1 && test_current_failures__ == 0) {
+        test_log_printf__("[   ");
+        test_print_in_color__(TEST_COLOR_GREEN_INTENSIVE__, "OK");
+        test_log_printf__("   ]\n");
+    }
+    if(test_verbose_level__ >= 1)
+        test_print_results__();
+#if defined(ACUTEST_PROFILE__)
+    if(test_profile__ && test_verbose_level__ >= 1)
+        test_prof_report__();
+#endif
+
+    test_log_flush__();
+}
+
+/* Called at exit. Processes the test forks inherit the handler, and run it
+ * too if they exit through Exit() or exit(): they must not report. */
+static void
+test_at_exit__(void)
+{
+    int in_test = test_current_running__;
+
+#if defined(ACUTEST_UNIX__)
+    if(test_pid__ != 0  &&  (long) getpid() != test_pid__)
+        return;
+#endif
+    test_finish__();
+    test_log_flush__();
+#if defined(ACUTEST_UNIX__)
+    /* Exit() exits with 0 whatever happened in the test: report failures
+     * in the exit status, as test_run__() expects. */
+    if(in_test && test_current_failures__ != 0)
+        _exit(1);
+#endif
+}
+
 /* Call directly the given test unit function. */
 static int
 test_do_run__(const struct test__* test)
@@ -437,18 +1627,37 @@ test_do_run__(const struct test__* test)
     test_current_unit__ = test;
     test_current_failures__ = 0;
     test_current_already_logged__ = 0;
+    test_check_count__ = 0;
+    test_results_used__ = 0;
+    test_param__ = test->param;
+    test_name__ = test->name;
+#if defined(ACUTEST_UNIX__)
+    test_pid__ = (long) getpid();
+#endif
+    memset(test_channel__, 0, sizeof(*test_channel__));
+    test_channel__->thread = -1;
 
     if(test_verbose_level__ >= 3) {
+#if defined(ACUTEST_KERNELS__)
+        test_print_in_color__(TEST_COLOR_DEFAULT_INTENSIVE__, "Test %s [%s]:\n",
+                test->name, test_kernel_labels__[test_kernel_current__]);
+#else
         test_print_in_color__(TEST_COLOR_DEFAULT_INTENSIVE__, "Test %s:\n", test->name);
+#endif
         test_current_already_logged__++;
     } else if(test_verbose_level__ >= 1) {
         int n;
         char spaces[48];
 
+#if defined(ACUTEST_KERNELS__)
+        n = test_print_in_color__(TEST_COLOR_DEFAULT_INTENSIVE__, "Test %s [%s]... ",
+                test->name, test_kernel_labels__[test_kernel_current__]);
+#else
         n = test_print_in_color__(TEST_COLOR_DEFAULT_INTENSIVE__, "Test %s... ", test->name);
+#endif
         memset(spaces, ' ', sizeof(spaces));
         if(n < (int) sizeof(spaces))
-            printf("%.*s", (int) sizeof(spaces) - n, spaces);
+            test_log_printf__("%.*s", (int) sizeof(spaces) - n, spaces);
     } else {
         test_current_already_logged__ = 1;
     }
@@ -457,10 +1666,24 @@ test_do_run__(const struct test__* test)
     try {
 #endif
 
-        /* This is good to do for case the test unit e.g. crashes. */
-        fflush(stdout);
+        /* This is good to do for case the test unit e.g. crashes or hangs:
+         * the test name is out before the test starts. */
+        test_log_flush__();
         fflush(stderr);
+#if defined(ACUTEST_UNIX__)
+        test_log_install_crash_handler__();
+#endif
 
+#if defined(ACUTEST_KERNELS__)
+        test_kernel_use__(test_kernel_current__);
+#endif
+        test_current_running__ = 1;
+        test_current_start__ = test_timer_now__();
+        test_channel__->start = test_current_start__;
+#if defined(ACUTEST_PROFILE__)
+        if(test_profile__)
+            test_prof_start__();
+#endif
         test->func();
 
 #ifdef __cplusplus
@@ -475,18 +1698,7 @@ test_do_run__(const struct test__* test)
     }
 #endif
 
-    if(test_verbose_level__ >= 3) {
-        switch(test_current_failures__) {
-            case 0:  test_print_in_color__(TEST_COLOR_GREEN_INTENSIVE__, "  All conditions have passed.\n\n"); break;
-            case 1:  test_print_in_color__(TEST_COLOR_RED_INTENSIVE__, "  One condition has FAILED.\n\n"); break;
-            default: test_print_in_color__(TEST_COLOR_RED_INTENSIVE__, "  %d conditions have FAILED.\n\n", test_current_failures__); break;
-        }
-    } else if(test_verbose_level__ >= 1 && test_current_failures__ == 0) {
-        printf("[   ");
-        test_print_in_color__(TEST_COLOR_GREEN_INTENSIVE__, "OK");
-        printf("   ]\n");
-    }
-
+    test_finish__();
     test_current_unit__ = NULL;
     return (test_current_failures__ == 0) ? 0 : -1;
 }
@@ -504,21 +1716,51 @@ test_error__(const char* fmt, ...)
         return;
 
     if(test_verbose_level__ <= 2  &&  !test_current_already_logged__  &&  test_current_unit__ != NULL) {
-        printf("[ ");
+        test_log_printf__("[ ");
         test_print_in_color__(TEST_COLOR_RED_INTENSIVE__, "FAILED");
-        printf(" ]\n");
+        test_log_printf__(" ]\n");
     }
 
     if(test_verbose_level__ >= 2) {
         test_print_in_color__(TEST_COLOR_RED_INTENSIVE__, "  Error: ");
         va_start(args, fmt);
-        vprintf(fmt, args);
+        test_log_vprintf__(fmt, args);
         va_end(args);
-        printf("\n");
+        test_log_printf__("\n");
     }
+    test_log_flush__();
 }
 #endif
 
+#if defined(ACUTEST_UNIX__)
+/* How far the test in the child got before it ended abnormally. */
+static void
+test_error_channel__(void)
+{
+    const struct test_channel__* ch = test_channel__;
+    const char* file = strrchr(ch->file, '/');
+    char thread[32] = "";
+
+    if(ch->thread >= 0)
+        sprintf(thread, " in thread %d", ch->thread);
+    if(ch->failures > 0)
+        test_error__("Ended%s after %lu conditions checked in %.3f s; %d failed, first at %s:%d",
+                thread, ch->checks, ch->seconds, ch->failures,
+                file != NULL ? file + 1 : ch->file, ch->line);
+    else
+        test_error__("Ended%s after %lu conditions checked in %.3f s",
+                thread, ch->checks, ch->seconds);
+}
+#endif
+
+/* Add the result of the test in the channel to the totals. */
+static void
+test_collect__(void)
+{
+    test_totals__->checks += test_channel__->checks;
+    test_totals__->seconds += test_channel__->seconds;
+}
+
 /* Trigger the unit test. If possible (and not suppressed) it starts a child
  * process who calls test_do_run__(), otherwise it calls test_do_run__()
  * directly. */
@@ -537,6 +1779,8 @@ test_run__(const struct test__* test)
         pid_t pid;
         int exit_code;
 
+        /* The child must not inherit (and print again) our pending output. */
+        test_log_flush__();
         pid = fork();
         if(pid == (pid_t)-1) {
             test_error__("Cannot fork. %s [%d]", strerror(errno), errno);
@@ -546,13 +1790,18 @@ test_run__(const struct test__* test)
             failed = (test_do_run__(test) != 0);
             exit(failed ? 1 : 0);
         } else {
-            /* Parent: Wait until child terminates and analyze its exit code. */
+            /* Parent: Wait until child terminates and analyze its exit code
+             * and the channel. */
             waitpid(pid, &exit_code, 0);
+            test_collect__();
+            if(test_channel__->failures > 0)
+                test_current_already_logged__ = 1;  /* The child said FAILED */
             if(WIFEXITED(exit_code)) {
                 switch(WEXITSTATUS(exit_code)) {
-                    case 0:   failed = 0; break;   /* test has passed. */
+                    case 0:   failed = (test_channel__->failures > 0); break;   /* test has passed. */
                     case 1:   /* noop */ break;    /* "normal" failure. */
                     default:  test_error__("Unexpected exit code [%d]", WEXITSTATUS(exit_code));
+                              test_error_channel__();
                 }
             } else if(WIFSIGNALED(exit_code)) {
                 char tmp[32];
@@ -569,6 +1818,7 @@ test_run__(const struct test__* test)
                     default:      sprintf(tmp, "signal %d", WTERMSIG(exit_code)); signame = tmp; break;
                 }
                 test_error__("Test interrupted by %s", signame);
+                test_error_channel__();
             } else {
                 test_error__("Test ended in an unexpected way [%d]", exit_code);
             }
@@ -604,12 +1854,14 @@ test_run__(const struct test__* test)
 
         /* A platform where we don't know how to run child process. */
         failed = (test_do_run__(test) != 0);
+        test_collect__();
 
 #endif
 
     } else {
         /* Child processes suppressed through --no-exec. */
         failed = (test_do_run__(test) != 0);
+        test_collect__();
     }
 
     test_current_unit__ = NULL;
@@ -619,6 +1871,122 @@ test_run__(const struct test__* test)
         test_stat_failed_units__++;
 }
 
+#if defined(ACUTEST_KERNELS__)
+/* Run the test once with each kernel. */
+static void
+test_kernel_run_all__(const struct test__* test)
+{
+    int k;
+
+    for(k = 0; k < test_kernel_count__; k++) {
+        struct test_kernel_run__* run = &test_kernel_runs__[test_kernel_run_count__];
+        int failed_before = test_stat_failed_units__;
+
+        test_kernel_current__ = k;
+        test_run__(test);
+        run->test = test;
+        run->kernel = k;
+        run->failed = (test_stat_failed_units__ != failed_before);
+        test_kernel_run_count__++;
+    }
+}
+
+/* Print one cell of the report, right-aligned in a column of width w. */
+static void
+test_kernel_cell__(int color, int w, const char* text)
+{
+    test_log_printf__("%*s", w - (int) strlen(text), "");
+    test_print_in_color__(color, "%s", text);
+}
+
+/* Print the verdicts and benchmark results of all kernels side by side:
+ * each benchmark's ns/op, and after the first kernel its ratio to the first
+ * kernel's, and at the end the geometric mean of each kernel's ratios. */
+static void
+test_kernel_report__(void)
+{
+    struct test_kernel_shared__* shared = test_kernel_shared__;
+    double log_sum[TEST_KERNELS_MAX] = { 0 };
+    int log_n[TEST_KERNELS_MAX] = { 0 };
+    char cell[32];
+    int r0, r, i, j, k;
+
+    test_log_printf__("\n%-40s", "");
+    for(k = 0; k < test_kernel_count__; k++)
+        test_kernel_cell__(TEST_COLOR_DEFAULT_INTENSIVE__, 20, test_kernel_labels__[k]);
+    test_log_printf__("\n");
+
+    for(r0 = 0; r0 < test_kernel_run_count__; r0 += test_kernel_count__) {
+        const struct test_kernel_run__* runs = &test_kernel_runs__[r0];
+
+        test_log_printf__("%-40.40s", runs[0].test->name);
+        for(k = 0; k < test_kernel_count__; k++) {
+            if(runs[k].failed)
+                test_kernel_cell__(TEST_COLOR_RED_INTENSIVE__, 20, "FAILED");
+            else
+                test_kernel_cell__(TEST_COLOR_GREEN_INTENSIVE__, 20, "OK");
+        }
+        test_log_printf__("\n");
+
+        /* One row per benchmark name, in order of first appearance */
+        for(i = 0; shared != NULL && i < shared->used; i++) {
+            const struct test_kernel_result__* first = &shared->results[i];
+            const struct test_kernel_result__* row[TEST_KERNELS_MAX] = { NULL };
+
+            if(first->run < r0 || first->run >= r0 + test_kernel_count__)
+                continue;
+            for(j = 0; j < i; j++) {
+                if(shared->results[j].run >= r0  &&  shared->results[j].run < r0 + test_kernel_count__  &&
+                   strcmp(shared->results[j].name, first->name) == 0)
+                    break;
+            }
+            if(j < i)
+                continue;
+            for(j = i; j < shared->used; j++) {
+                r = shared->results[j].run;
+                if(r >= r0  &&  r < r0 + test_kernel_count__  &&  row[r - r0] == NULL  &&
+                   strcmp(shared->results[j].name, first->name) == 0)
+                    row[r - r0] = &shared->results[j];
+            }
+
+            test_log_printf__("  %-38.38s", first->name);
+            for(k = 0; k < test_kernel_count__; k++) {
+                if(row[k] == NULL) {
+                    snprintf(cell, sizeof(cell), "-");
+                } else if(k == 0 || row[0] == NULL || row[0]->ns <= 0.0 || row[k]->ns <= 0.0) {
+                    snprintf(cell, sizeof(cell), "%.1f ns", row[k]->ns);
+                } else {
+                    snprintf(cell, sizeof(cell), "%.1f ns %6.2fx", row[k]->ns, row[k]->ns / row[0]->ns);
+                    log_sum[k] += log(row[k]->ns / row[0]->ns);
+                    log_n[k]++;
+                }
+                test_kernel_cell__(TEST_COLOR_DEFAULT__, 20, cell);
+            }
+            test_log_printf__("\n");
+        }
+    }
+
+    if(shared != NULL && shared->used == TEST_KERNELS_RESULTS)
+        test_log_printf__("  (further benchmark results were dropped)\n");
+    for(k = 1; k < test_kernel_count__; k++) {
+        if(log_n[k] > 0)
+            break;
+    }
+    if(k < test_kernel_count__) {
+        test_log_printf__("%-40s%20s", "geometric mean of ratios", "");
+        for(k = 1; k < test_kernel_count__; k++) {
+            if(log_n[k] > 0)
+                snprintf(cell, sizeof(cell), "%.2fx", exp(log_sum[k] / log_n[k]));
+            else
+                snprintf(cell, sizeof(cell), "-");
+            test_kernel_cell__(TEST_COLOR_DEFAULT_INTENSIVE__, 20, cell);
+        }
+        test_log_printf__("\n");
+    }
+    test_log_printf__("\n");
+}
+#endif
+
 #if defined(ACUTEST_WIN__)
 /* Callback for SEH events. */
 static LONG CALLBACK
@@ -658,6 +2026,16 @@ test_help__(void)
     printf("                          1 ... Output one line per test (and summary)\n");
     printf("                          2 ... As 1 and failed conditions (this is default)\n");
     printf("                          3 ... As 1 and all conditions (and extended summary)\n");
+    printf("      --verbose=stream  Print output as it happens instead of collecting it\n");
+    printf("                          in memory until a failure or the end of the test\n");
+#if defined(ACUTEST_PROFILE__)
+    printf("      --profile         Sample each test and print its flat profile\n");
+#endif
+#if defined(ACUTEST_KERNELS__)
+    printf("      --kernel=SO       Run each test with the kernel in shared object SO,\n");
+    printf("                          or with the reference kernel for 'ref'; give\n");
+    printf("                          several to compare them side by side\n");
+#endif
     printf("      --color=WHEN      Enable colorized output\n");
     printf("                          (WHEN is one of 'auto', 'always', 'never')\n");
     printf("  -h, --help            Display this help and exit\n");
@@ -726,10 +2104,8 @@ void Main(int argc, char **argv)
     test_colorize__ = 0;
 #endif
 
-    /* Count all test units */
-    test_list_size__ = 0;
-    for(i = 0; test_list__[i].func != NULL; i++)
-        test_list_size__++;
+    /* Expand parameterized tests into their cases */
+    test_expand_list__();
 
     tests__ = (const struct test__**) malloc(sizeof(const struct test__*) * test_list_size__);
     test_flags__ = (char*) malloc(sizeof(char) * test_list_size__);
@@ -754,6 +2130,8 @@ void Main(int argc, char **argv)
             exit(0);
         } else if(strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0) {
             test_verbose_level__++;
+        } else if(strcmp(argv[i], "--verbose=stream") == 0) {
+            test_log_stream__ = 1;
         } else if(strncmp(argv[i], "--verbose=", 10) == 0) {
             test_verbose_level__ = atoi(argv[i] + 10);
         } else if(strcmp(argv[i], "--color=auto") == 0) {
@@ -770,6 +2148,15 @@ void Main(int argc, char **argv)
             test_no_exec__ = 0;
         } else if(strcmp(argv[i], "--exec=never") == 0 || strcmp(argv[i], "--no-exec") == 0 || strcmp(argv[i], "-E") == 0) {
             test_no_exec__ = 1;
+#if defined(ACUTEST_PROFILE__)
+        } else if(strcmp(argv[i], "--profile") == 0) {
+            test_profile__ = 1;
+#endif
+#if defined(ACUTEST_KERNELS__)
+        } else if(strncmp(argv[i], "--kernel=", 9) == 0) {
+            if(test_kernel_add__(argv[i] + 9) != 0)
+                exit(2);
+#endif
         } else if(strcmp(argv[i], "--no-summary") == 0) {
             test_no_summary__ = 1;
         } else if(strcmp(argv[i], "--list") == 0 || strcmp(argv[i], "-l") == 0) {
@@ -786,6 +2173,46 @@ void Main(int argc, char **argv)
     SetUnhandledExceptionFilter(test_exception_filter__);
 #endif
 
+    /* The kernel ends the process via Exit() once the last thread exits, so
+     * the end of a test is not always seen by test_do_run__(). */
+    atexit(test_at_exit__);
+
+    /* Passing conditions are only counted unless they are all printed, or
+     * seen by the check hook. */
+    test_fast_checks__ = (test_verbose_level__ < 3  &&  test_check_hook__ == NULL);
+
+#if defined(ACUTEST_UNIX__)
+    {
+        void* channel = mmap(NULL, sizeof(struct test_channel__), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if(channel != MAP_FAILED)
+            test_channel__ = (struct test_channel__*) channel;
+    }
+#endif
+#if defined(ACUTEST_KERNELS__)
+    if(test_kernel_count__ == 0) {
+        fprintf(stderr, "%s: No kernel given; use --kernel=SO or --kernel=ref\n", argv[0]);
+        fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+        exit(2);
+    }
+    if(test_kernel_count__ > 1  &&  test_no_exec__ == 1) {
+        fprintf(stderr, "%s: Several kernels need child processes; drop --no-exec\n", argv[0]);
+        exit(2);
+    }
+    {
+        void* shared = mmap(NULL, sizeof(struct test_kernel_shared__), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if(shared != MAP_FAILED)
+            test_kernel_shared__ = (struct test_kernel_shared__*) shared;
+    }
+    test_kernel_runs__ = (struct test_kernel_run__*)
+            malloc(sizeof(struct test_kernel_run__) * test_list_size__ * test_kernel_count__);
+    if(test_kernel_runs__ == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(2);
+    }
+#endif
+
     /* By default, display the help message. */
     if (argc < 2 || test_count__ == 0) {
         test_help__();
@@ -796,7 +2223,11 @@ void Main(int argc, char **argv)
     if(test_no_exec__ < 0) {
         test_no_exec__ = 0;
 
+#if defined(ACUTEST_KERNELS__)
+        if(test_count__ <= 1  &&  test_kernel_count__ <= 1) {
+#else
         if(test_count__ <= 1) {
+#endif
             test_no_exec__ = 1;
         } else {
 #ifdef ACUTEST_WIN__
@@ -814,42 +2245,59 @@ void Main(int argc, char **argv)
     if(!test_skip_mode__) {
         /* Run the listed tests. */
         for(i = 0; i < (int) test_count__; i++)
+#if defined(ACUTEST_KERNELS__)
+            test_kernel_run_all__(tests__[i]);
+#else
             test_run__(tests__[i]);
+#endif
     } else {
         /* Run all tests except those listed. */
-        for(i = 0; test_list__[i].func != NULL; i++) {
+        for(i = 0; test_cases__[i].func != NULL; i++) {
             if(!test_flags__[i])
-                test_run__(&test_list__[i]);
+#if defined(ACUTEST_KERNELS__)
+                test_kernel_run_all__(&test_cases__[i]);
+#else
+                test_run__(&test_cases__[i]);
+#endif
         }
     }
+#if defined(ACUTEST_KERNELS__)
+    if(test_kernel_count__ > 1  &&  test_verbose_level__ >= 1)
+        test_kernel_report__();
+#endif
 
     /* Write a summary */
     if(!test_no_summary__ && test_verbose_level__ >= 1) {
         if(test_verbose_level__ >= 3) {
             test_print_in_color__(TEST_COLOR_DEFAULT_INTENSIVE__, "Summary:\n");
 
-            printf("  Count of all unit tests:     %4d\n", (int) test_list_size__);
-            printf("  Count of run unit tests:     %4d\n", test_stat_run_units__);
-            printf("  Count of failed unit tests:  %4d\n", test_stat_failed_units__);
-            printf("  Count of skipped unit tests: %4d\n", (int) test_list_size__ - test_stat_run_units__);
-            printf("  ");
+            test_log_printf__("  Count of all unit tests:     %4d\n", (int) test_list_size__);
+            test_log_printf__("  Count of run unit tests:     %4d\n", test_stat_run_units__);
+            test_log_printf__("  Count of failed unit tests:  %4d\n", test_stat_failed_units__);
+            test_log_printf__("  Count of skipped unit tests: %4d\n", (int) test_list_size__ - test_stat_run_units__);
+            test_log_printf__("  Count of checked conditions: %4lu (%.0f per second)\n",
+                    test_totals__->checks,
+                    (test_totals__->seconds > 0.0) ? (double) test_totals__->checks / test_totals__->seconds : 0.0);
+            test_log_printf__("  ");
         }
 
         if(test_stat_failed_units__ == 0) {
             test_print_in_color__(TEST_COLOR_GREEN_INTENSIVE__, "SUCCESS:");
-            printf(" All unit tests have passed.\n");
+            test_log_printf__(" All unit tests have passed.\n");
         } else {
             test_print_in_color__(TEST_COLOR_RED_INTENSIVE__, "FAILED:");
-            printf(" %d of %d unit tests have failed.\n",
+            test_log_printf__(" %d of %d unit tests have failed.\n",
                     test_stat_failed_units__, test_stat_run_units__);
         }
 
         if(test_verbose_level__ >= 3)
-            printf("\n");
+            test_log_printf__("\n");
     }
+    test_log_flush__();
 
     free((void*) tests__);
     free((void*) test_flags__);
+    test_free_list__();
 
     // return (test_stat_failed_units__ == 0) ? 0 : 1;
 }
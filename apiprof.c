@@ -0,0 +1,347 @@
+/**
+ * Kernel API profiler, linked into the myprof and refprof runners.
+ *
+ * The runners are linked with -Wl,--wrap for each kernel API function, so
+ * every call the tests make lands in the __wrap_ functions below, which
+ * count the call and time it before passing it on to the kernel (__real_).
+ * A profile of each test is printed to stderr when the test ends, before its
+ * verdict.
+ *
+ * A call's latency is the time from entering the kernel until the kernel
+ * hands the CPU back to some thread: the return of any API call, or the
+ * start of a new thread. Time spent running other threads in between is not
+ * counted, so a yield costs just the switch. Exit has no caller to return
+ * to, so its latency is the switch to the next thread.
+ *
+ * Built with -DPROFILE_ALLOCS (the myalloc runner), malloc, calloc, realloc,
+ * free, mmap, munmap and mprotect are wrapped too, for calls made by your
+ * kernel and the tests. Those made while a kernel call is in progress are
+ * counted against it, and the test fails if the kernel allocates memory on
+ * a warm path: a CreateThread that fails or reuses an ID it created before
+ * (setting up a thread slot the first time may allocate), or a YieldThread,
+ * SchedThread or ExitThread after its first P_WARMUP calls.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "aux.h"
+#include "umix.h"
+#include "mykernel4.h"
+
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#ifdef PROFILE_ALLOCS
+#include <sys/mman.h>
+#endif
+
+#ifdef USE_REFERENCE_KERNEL
+#define API(name) name
+#else
+#define API(name) My##name
+#endif
+#define CAT2(a, b) a##b
+#define CAT(a, b)  CAT2(a, b)
+#define WRAP(name) CAT(__wrap_, API(name))
+#define REAL(name) CAT(__real_, API(name))
+
+void REAL(InitThreads)();
+int  REAL(CreateThread)(void (*func)(), int param);
+int  REAL(GetThread)();
+int  REAL(YieldThread)(int t);
+void REAL(SchedThread)();
+void REAL(ExitThread)();
+void WRAP(ExitThread)();
+
+enum { P_INIT, P_CREATE, P_GET, P_YIELD, P_SCHED, P_EXIT, P_NUM };
+static const char *p_names[P_NUM] = {
+	"InitThreads", "CreateThread", "GetThread",
+	"YieldThread", "SchedThread",  "ExitThread",
+};
+
+#define P_BUCKETS 40	// latency histogram buckets: [2^(b-1), 2^b) ns
+#define P_WARMUP  MAXTHREADS	// calls before an API must stop allocating
+
+enum { A_MALLOC, A_FREE, A_MMAP, A_MUNMAP, A_MPROTECT, A_NUM };
+static const char *a_names[A_NUM] = {
+	"allocs", "frees", "mmap", "munmap", "mprotect",
+};
+
+static struct {
+	unsigned long calls[P_NUM];
+	unsigned long timed[P_NUM];	// calls whose latency is known
+	unsigned long hist[P_NUM][P_BUCKETS];
+	long long total_ns[P_NUM];
+	long long max_ns[P_NUM];
+
+	// Memory calls made during kernel calls, and allocations after warmup
+	unsigned long mem[P_NUM][A_NUM];
+	unsigned long steady[P_NUM];
+	unsigned long call_allocs;	// allocations of the call in progress
+	int created[MAXTHREADS];	// IDs created since InitThreads
+
+	// The call currently inside the kernel, if any
+	int pending, pending_api;
+	long long pending_start;
+
+	// Functions of created threads that have not started yet
+	struct {
+		void (*func)();
+		int param, used;
+	} starts[MAXTHREADS];
+
+} prof;
+
+static long long p_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int p_bucket(long long ns) {
+	int b = 0;
+	while (ns > 0 && b < P_BUCKETS - 1) {
+		ns >>= 1;
+		++b;
+	}
+	return b;
+}
+
+// Upper bound of the bucket holding the given fraction of the timed calls
+static long long p_percentile(int api, double fraction) {
+	unsigned long want = (unsigned long) (prof.timed[api] * fraction);
+	unsigned long seen = 0;
+	for (int b = 0; b < P_BUCKETS; ++b) {
+		seen += prof.hist[api][b];
+		if (seen > want) { return 1LL << b; }
+	}
+	return 1LL << (P_BUCKETS - 1);
+}
+
+// The end hook of the test (see acutest.h): nothing to do if it crashed
+static void p_report(int sig) {
+	long long all_ns = 0;
+
+	if (sig != 0 || prof.calls[P_INIT] == 0) { return; }
+	for (int api = 0; api < P_NUM; ++api) { all_ns += prof.total_ns[api]; }
+
+	fprintf(stderr, "\nKernel API profile (latency in ns; "
+			"p50/p99 are bucket upper bounds):\n");
+	fprintf(stderr, "  %-13s %9s %12s %6s %9s %9s %9s %9s\n",
+			"call", "calls", "total", "share", "mean", "p50", "p99", "max");
+	for (int api = 0; api < P_NUM; ++api) {
+		if (prof.timed[api] == 0) { continue; }
+		fprintf(stderr, "  %-13s %9lu %12lld %5.1f%% %9lld %9lld %9lld %9lld\n",
+				p_names[api], prof.calls[api], prof.total_ns[api],
+				all_ns ? 100.0 * prof.total_ns[api] / all_ns : 0.0,
+				prof.total_ns[api] / (long long) prof.timed[api],
+				p_percentile(api, 0.50), p_percentile(api, 0.99),
+				prof.max_ns[api]);
+	}
+
+	fprintf(stderr, "  Histogram (calls per latency bucket):\n");
+	for (int api = 0; api < P_NUM; ++api) {
+		if (prof.timed[api] == 0) { continue; }
+		fprintf(stderr, "    %-13s", p_names[api]);
+		for (int b = 0; b < P_BUCKETS; ++b) {
+			if (prof.hist[api][b]) {
+				fprintf(stderr, " <%lld:%lu", 1LL << b, prof.hist[api][b]);
+			}
+		}
+		fprintf(stderr, "\n");
+	}
+
+#ifdef PROFILE_ALLOCS
+	fprintf(stderr, "  Memory calls made by the kernel (per call):\n");
+	fprintf(stderr, "    %-13s", "call");
+	for (int a = 0; a < A_NUM; ++a) { fprintf(stderr, " %14s", a_names[a]); }
+	fprintf(stderr, " %14s\n", "warm allocs");
+	for (int api = 0; api < P_NUM; ++api) {
+		if (prof.calls[api] == 0) { continue; }
+		fprintf(stderr, "    %-13s", p_names[api]);
+		for (int a = 0; a < A_NUM; ++a) {
+			fprintf(stderr, " %5lu (%6.2f)", prof.mem[api][a],
+					(double) prof.mem[api][a] / prof.calls[api]);
+		}
+		fprintf(stderr, " %14lu\n", prof.steady[api]);
+	}
+
+	for (int api = P_CREATE; api < P_NUM; ++api) {
+		if (api == P_GET) { continue; }
+		TEST_CHECK_(prof.steady[api] == 0,
+				"%s allocated %lu times on a warm path",
+				p_names[api], prof.steady[api]);
+	}
+#endif
+
+	// Tests run in one process (--no-exec) each get their own profile
+	memset(prof.calls, 0, sizeof(prof.calls));
+	memset(prof.timed, 0, sizeof(prof.timed));
+	memset(prof.hist, 0, sizeof(prof.hist));
+	memset(prof.total_ns, 0, sizeof(prof.total_ns));
+	memset(prof.max_ns, 0, sizeof(prof.max_ns));
+	memset(prof.mem, 0, sizeof(prof.mem));
+	memset(prof.steady, 0, sizeof(prof.steady));
+}
+
+// The kernel handed the CPU back to a thread: the pending call is complete
+static void p_leave() {
+	long long ns;
+	if (!prof.pending) { return; }
+	ns = p_now() - prof.pending_start;
+	prof.pending = 0;
+	++prof.timed[prof.pending_api];
+	++prof.hist[prof.pending_api][p_bucket(ns)];
+	prof.total_ns[prof.pending_api] += ns;
+	if (ns > prof.max_ns[prof.pending_api]) {
+		prof.max_ns[prof.pending_api] = ns;
+	}
+}
+
+#ifdef PROFILE_ALLOCS
+// A memory call: count it against the kernel call in progress, if any
+static void a_count(int a) {
+	if (!prof.pending) { return; }
+	++prof.mem[prof.pending_api][a];
+	if (a != A_MALLOC && a != A_MMAP) { return; }
+	++prof.call_allocs;
+	if (prof.pending_api != P_CREATE && prof.calls[prof.pending_api] > P_WARMUP) {
+		++prof.steady[prof.pending_api];
+	}
+}
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+void  __real_free(void *p);
+void *__real_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off);
+int   __real_munmap(void *addr, size_t len);
+int   __real_mprotect(void *addr, size_t len, int prot);
+
+void *__wrap_malloc(size_t size) {
+	a_count(A_MALLOC);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+	a_count(A_MALLOC);
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+	a_count(A_MALLOC);
+	return __real_realloc(p, size);
+}
+
+void __wrap_free(void *p) {
+	if (p != NULL) { a_count(A_FREE); }
+	__real_free(p);
+}
+
+void *__wrap_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off) {
+	a_count(A_MMAP);
+	return __real_mmap(addr, len, prot, flags, fd, off);
+}
+
+int __wrap_munmap(void *addr, size_t len) {
+	a_count(A_MUNMAP);
+	return __real_munmap(addr, len);
+}
+
+int __wrap_mprotect(void *addr, size_t len, int prot) {
+	a_count(A_MPROTECT);
+	return __real_mprotect(addr, len, prot);
+}
+#endif
+
+static void p_enter(int api) {
+	p_leave();	// no-op unless the kernel called back into the API
+	++prof.calls[api];
+	prof.call_allocs = 0;
+	prof.pending = 1;
+	prof.pending_api = api;
+	prof.pending_start = p_now();
+}
+
+// Every created thread starts here, so that its start completes the call
+// that switched to it. Returning from the thread function exits the thread
+// just as the kernel would, but through the wrapper so that it is counted.
+static void p_start(int slot) {
+	void (*func)() = prof.starts[slot].func;
+	int param = prof.starts[slot].param;
+	p_leave();
+	prof.starts[slot].used = 0;
+	func(param);
+	WRAP(ExitThread)();
+}
+
+// Failure and crash reports ask for the running thread: not a call to profile
+__attribute__((constructor)) static void p_init() {
+	test_thread_id__ = REAL(GetThread);
+	test_end_hook__ = p_report;
+}
+
+void WRAP(InitThreads)() {
+	test_perf_off__ = "kernel calls are profiled";
+	for (int i = 0; i < MAXTHREADS; ++i) {
+		prof.starts[i].used = 0;
+		prof.created[i] = 0;
+	}
+	p_enter(P_INIT);
+	REAL(InitThreads)();
+	p_leave();
+}
+
+int WRAP(CreateThread)(void (*func)(), int param) {
+	int slot, created;
+
+	for (slot = 0; slot < MAXTHREADS && prof.starts[slot].used; ++slot);
+	p_enter(P_CREATE);
+	if (slot == MAXTHREADS) {
+		// No free slot (cannot happen with a correct kernel); create the
+		// thread unprofiled
+		created = REAL(CreateThread)(func, param);
+	} else {
+		prof.starts[slot].func = func;
+		prof.starts[slot].param = param;
+		prof.starts[slot].used = 1;
+		created = REAL(CreateThread)(p_start, slot);
+		if (created == -1) { prof.starts[slot].used = 0; }
+	}
+	if (created < 0 || created >= MAXTHREADS || prof.created[created]) {
+		prof.steady[P_CREATE] += prof.call_allocs;
+	} else {
+		prof.created[created] = 1;
+	}
+	p_leave();
+	return created;
+}
+
+int WRAP(GetThread)() {
+	int t;
+	p_enter(P_GET);
+	t = REAL(GetThread)();
+	p_leave();
+	return t;
+}
+
+int WRAP(YieldThread)(int t) {
+	int from;
+	p_enter(P_YIELD);
+	from = REAL(YieldThread)(t);
+	p_leave();
+	return from;
+}
+
+void WRAP(SchedThread)() {
+	p_enter(P_SCHED);
+	REAL(SchedThread)();
+	p_leave();
+}
+
+void WRAP(ExitThread)() {
+	p_enter(P_EXIT);
+	REAL(ExitThread)();
+}
@@ -2,60 +2,91 @@
 # This function will assimilate the valid tests and make the following changes:
 # - Write tests.c to initialize global test array
 # - Change tests/Makefile to include the valid tests at compile time
+# The benchmarks are assimilated the same way, into benches.c and
+# benchmarks/Makefile.
 
 BASE_DIR=~/pa4
-TEST_DIR=$BASE_DIR/tests
-MAIN_FILE=$BASE_DIR/tests.c
 
-if [ "$1" == "clean" ]; then
-  echo "Cleaning tests..."
-
-  cd $TEST_DIR
-  rm -f $MAIN_FILE
+# clean DIR MAIN_FILE
+clean() {
+  cd $1
+  rm -f $2
   sed "s/^SRC.*/SRC     =/" Makefile > _Makefile
   mv _Makefile Makefile
+}
 
-  echo "Cleaning complete."
-  exit 0
-fi
-
-echo "Assimilating tests..."
+# assimilate DIR MAIN_FILE
+assimilate() {
+  cd $1
+  rm -f $2
+  tests=`ls -1 *.c 2> /dev/null | sed 's/\.c$//'`
+  testArray=($tests)
 
-cd $TEST_DIR
-rm -f $MAIN_FILE
-tests=`ls -1 *.c 2> /dev/null | sed 's/\.c$//'`
-testArray=($tests)
+  for test in ${testArray[@]}; do
+    findFun=`grep "void.*$test.*\\(.*\\)" "$test.c"`
 
-for test in ${testArray[@]}; do
-  findFun=`grep "void.*$test.*\\(.*\\)" "$test.c"`
+    if [ -z "$findFun" ]; then
+      echo "Warning: File $test.c does not have a function with the same name as the file. Skipping"
+      tests=`echo "$tests" | grep -v "^$test$"`
+    fi
+  done
 
-  if [ -z "$findFun" ]; then
-    echo "Warning: File $test.c does not have a function with the same name as the file. Skipping"
-    tests=`echo "$tests" | grep -v "^$test$"`
+  if [ -z "$tests" ]; then
+    echo "No valid tests found in $1! Aborting"
+    exit 1
   fi
-done
 
-if [ -z "$tests" ]; then
-  echo "No valid tests found! Aborting"
-  exit 1
+  # Tests declaring TEST_PARAMS(name, ...) are registered with their parameters
+  paramTests=`grep -l "^TEST_PARAMS(" *.c 2> /dev/null | sed 's/\.c$//'`
+
+  # acutest reports the running thread when a test fails or crashes
+  echo "#include \"aux.h\""                          >  $2
+  echo "#include \"umix.h\""                         >> $2
+  echo "#include \"mykernel4.h\""                    >> $2
+  echo "#ifdef USE_REFERENCE_KERNEL"                  >> $2
+  echo "#define TEST_THREAD_ID GetThread"             >> $2
+  echo "#else"                                        >> $2
+  echo "#define TEST_THREAD_ID MyGetThread"           >> $2
+  echo "#endif"                                       >> $2
+  echo "#include \"acutest.h\""                       >> $2
+  echo                                                >> $2
+  echo "$tests" | sed 's/^/extern void /;s/$/();/'    >> $2
+  for test in $paramTests; do
+    if echo "$tests" | grep -q "^$test$"; then
+      echo "extern const struct test_params__ ${test}_params__;" >> $2
+    fi
+  done
+  echo                                                >> $2
+  echo "TEST_LIST = {"                                >> $2
+  for test in $tests; do
+    if echo "$paramTests" | grep -q "^$test$"; then
+      printf '\t{"%s", %s, &%s_params__},\n' $test $test $test >> $2
+    else
+      printf '\t{"%s", %s},\n' $test $test          >> $2
+    fi
+  done
+  printf '\t{0}\n'                                    >> $2
+  echo "};"                                           >> $2
+
+  tests=`echo "$tests" | sed 's/$/.c/g'`
+  testsLine=`echo $tests`
+  sed "s/^SRC.*/SRC     = $testsLine/" Makefile > _Makefile
+  mv _Makefile Makefile
+}
+
+if [ "$1" == "clean" ]; then
+  echo "Cleaning tests..."
+
+  clean $BASE_DIR/tests $BASE_DIR/tests.c
+  clean $BASE_DIR/benchmarks $BASE_DIR/benches.c
+
+  echo "Cleaning complete."
+  exit 0
 fi
 
-echo "$tests"                                       >  _testList
-tests2=`paste -d '|' _testList _testList`
-rm _testList
-
-echo "#include \"acutest.h\""                       >  $MAIN_FILE
-echo                                                >> $MAIN_FILE
-echo "$tests" | sed 's/^/extern void /;s/$/();/'    >> $MAIN_FILE
-echo                                                >> $MAIN_FILE
-echo "TEST_LIST = {"                                >> $MAIN_FILE
-echo "$tests2" | sed "s/^/	{\"/;s/|/\", /;s/$/},/" >> $MAIN_FILE
-echo "\t{0}"                                        >> $MAIN_FILE
-echo "};"                                           >> $MAIN_FILE
-
-tests=`echo "$tests" | sed 's/$/.c/g'`
-testsLine=`echo $tests`
-sed "s/^SRC.*/SRC     = $testsLine/" Makefile > _Makefile
-mv _Makefile Makefile
+echo "Assimilating tests..."
+
+assimilate $BASE_DIR/tests $BASE_DIR/tests.c
+assimilate $BASE_DIR/benchmarks $BASE_DIR/benches.c
 
 echo "Assimilation complete."
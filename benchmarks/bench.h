@@ -0,0 +1,144 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "../tests/tests.h"
+
+/**
+ * Benchmark harness: benchmarks are acutest units like the tests (the same
+ * runner, kernel name mapping and TEST_CHECK), built into mybench/refbench.
+ *
+ * BENCH times the statement that follows it:
+ *
+ *   BENCH("yield") {
+ *       MyYieldThread(t);
+ *   }
+ *
+ * The statement is run in batches. Batch sizes are first grown until a batch
+ * takes BENCH_BATCH_NS, then BENCH_REPS batches of that size are timed, and
+ * the median and minimum time per iteration, and the median cycles per
+ * iteration, are reported with TEST_RESULT as
+ *
+ *   bench yield: 212.4 ns/op, 651 cycles/op (min 208.9 ns, spread 3.1%, 5 x 131072)
+ *
+ * BENCH_OPS(n, name) does the same for statements doing n operations each,
+ * and reports per operation. Names are printf formats. After the loop,
+ * BENCH_NS() is the median ns per operation of the last benchmark.
+ *
+ * Cycles come from the CPU's timestamp counter (rdtsc on x86, cntvct_el0 on
+ * ARM64), or are nanoseconds on other machines.
+ */
+
+#ifndef BENCH_BATCH_NS
+#define BENCH_BATCH_NS 20000000LL	// 20 ms
+#endif
+#ifndef BENCH_REPS
+#define BENCH_REPS     5
+#endif
+
+#define BENCH(...)          BENCH_OPS(1, __VA_ARGS__)
+#define BENCH_OPS(ops, ...)                                                   \
+	for (struct bench__ bench__ = bench_start__((ops), __VA_ARGS__);          \
+			bench_next__(&bench__); )
+#define BENCH_NS()          (bench_last_ns__)
+
+// Keep the compiler from optimizing away the computation of x
+#define BENCH_DO_NOT_OPTIMIZE(x) __asm__ volatile("" : : "g"(x) : "memory")
+// Keep the compiler from caching memory in registers across this point
+#define BENCH_CLOBBER()          __asm__ volatile("" : : : "memory")
+
+struct bench__ {
+	char name[64];
+	long long ops, n, i, start_ns, ns[BENCH_REPS];
+	unsigned long long start_cycles, cycles[BENCH_REPS];
+	int rep;	// -1 while calibrating
+};
+
+static double bench_last_ns__;
+
+static inline unsigned long long bench_cycles__() {
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned lo, hi;
+	__asm__ volatile("lfence; rdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+	return ((unsigned long long) hi << 32) | lo;
+#elif defined(__aarch64__)
+	unsigned long long v;
+	__asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(v) : : "memory");
+	return v;
+#else
+	return test_now_ns();
+#endif
+}
+
+// Start a batch; `done` iterations of it are under way
+static inline void bench_batch_start__(struct bench__ *b, long long done) {
+	b->i = done;
+	b->start_ns = test_now_ns();
+	b->start_cycles = bench_cycles__();
+}
+
+static struct bench__ bench_start__(long long ops, const char *fmt, ...)
+		__attribute__((format(printf, 2, 3)));
+static struct bench__ bench_start__(long long ops, const char *fmt, ...) {
+	struct bench__ b;
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(b.name, sizeof(b.name), fmt, args);
+	va_end(args);
+	b.ops = ops;
+	b.n = 1;
+	b.rep = -1;
+	bench_batch_start__(&b, 0);
+	return b;
+}
+
+static int bench_cmp__(const void *a, const void *b) {
+	long long x = *(const long long *) a, y = *(const long long *) b;
+	return (x > y) - (x < y);
+}
+
+// A batch is over: grow it, time it, or report. Returns 0 when done.
+static int bench_batch__(struct bench__ *b) {
+	long long ns = test_now_ns() - b->start_ns;
+	unsigned long long cycles = bench_cycles__() - b->start_cycles;
+	long long sorted[BENCH_REPS];
+	double per_op, min, spread;
+
+	if (b->rep < 0) {
+		if (ns < BENCH_BATCH_NS) {
+			// Aim 20% past the target, growing at most 100x at a time
+			long long want = ns > 0 ? b->n * (BENCH_BATCH_NS * 6 / 5) / ns : b->n * 100;
+			b->n = want > b->n * 100 ? b->n * 100 : want > b->n ? want : b->n + 1;
+		} else {
+			b->rep = 0;
+		}
+		bench_batch_start__(b, 1);
+		return 1;
+	}
+
+	b->ns[b->rep] = ns;
+	b->cycles[b->rep] = cycles;
+	if (++b->rep < BENCH_REPS) {
+		bench_batch_start__(b, 1);
+		return 1;
+	}
+
+	memcpy(sorted, b->ns, sizeof(sorted));
+	qsort(sorted, BENCH_REPS, sizeof(sorted[0]), bench_cmp__);
+	per_op = (double) (b->n * b->ops);
+	bench_last_ns__ = sorted[BENCH_REPS / 2] / per_op;
+	min = sorted[0] / per_op;
+	spread = 100.0 * (sorted[BENCH_REPS - 1] - sorted[0]) / sorted[BENCH_REPS / 2];
+	qsort(b->cycles, BENCH_REPS, sizeof(b->cycles[0]), bench_cmp__);
+	TEST_RESULT("bench %s: %.1f ns/op, %.0f cycles/op "
+			"(min %.1f ns, spread %.1f%%, %d x %lld)", b->name, bench_last_ns__,
+			b->cycles[BENCH_REPS / 2] / per_op, min, spread, BENCH_REPS, b->n);
+	return 0;
+}
+
+static inline int bench_next__(struct bench__ *b) {
+	if (b->i++ < b->n) { return 1; }
+	return bench_batch__(b);
+}
+
+#endif
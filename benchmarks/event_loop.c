@@ -0,0 +1,210 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+/**
+ * Benchmark: an event-driven echo server on green threads.
+ *
+ * Each of `conns` worker threads serves one end of a socketpair with
+ * non-blocking I/O: it echoes whatever it reads, and calls MySchedThread()
+ * whenever a read or write would block. T0 is the poller: it waits in
+ * epoll_wait() for connections with pending requests and yields to the
+ * worker of each one.
+ *
+ * A forked load generator holds the other ends. It keeps one request (a
+ * timestamp) in flight on every connection, and records the latency of
+ * each echo after a warm-up. The benchmark reports the requests per second
+ * (and their inverse as a bench line, for compare.sh), the median and p99
+ * latency, and the switches per request.
+ */
+
+#define T19_WARMUP_NS  50000000LL	// 50 ms
+#define T19_RUN_NS     250000000LL	// 250 ms
+#define T19_MAX_LAT    (1 << 20)	// latencies kept for the percentiles
+#define T19_POLL_MS    100
+
+TEST_PARAMS(event_loop, "conns", 1, MAXTHREADS - 1);
+
+static struct {
+	int conns, open, failed;
+	int fd[MAXTHREADS], peer[MAXTHREADS], tid[MAXTHREADS], closed[MAXTHREADS];
+	long long yields, scheds, served;
+	// Written by the load generator
+	struct {
+		long long requests, bad, lat_count;
+		long long lat[T19_MAX_LAT];
+	} *shared;
+} d19;
+
+static void t19_worker(int i) {
+	char buf[256];
+	int fd = d19.fd[i];
+
+	for (;;) {
+		ssize_t n = read(fd, buf, sizeof(buf));
+
+		if (n == 0) { break; }
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EINTR) { ++d19.failed; break; }
+			++d19.scheds;
+			MySchedThread();
+			continue;
+		}
+		for (ssize_t off = 0; off < n; ) {
+			ssize_t w = send(fd, buf + off, n - off, MSG_NOSIGNAL);
+
+			if (w > 0) {
+				off += w;
+			} else if (w < 0 && (errno == EAGAIN || errno == EINTR)) {
+				++d19.scheds;
+				MySchedThread();
+			} else {
+				++d19.failed;
+				goto out;
+			}
+		}
+		d19.served += n / (ssize_t) sizeof(long long);
+	}
+out:
+	close(fd);
+	d19.closed[i] = 1;
+	--d19.open;
+}
+
+// Load generator: runs in the forked child, without the thread kernel
+static void t19_client() {
+	struct epoll_event ev[MAXTHREADS];
+	long long sent[MAXTHREADS];
+	long long start, warm, end, now;
+	int ep = epoll_create1(0);
+
+	if (ep == -1) { _exit(1); }
+	start = test_now_ns();
+	warm = start + T19_WARMUP_NS;
+	end = warm + T19_RUN_NS;
+	for (int i = 0; i < d19.conns; ++i) {
+		struct epoll_event e = { .events = EPOLLIN, .data.u32 = i };
+		if (epoll_ctl(ep, EPOLL_CTL_ADD, d19.peer[i], &e) == -1) { _exit(1); }
+		sent[i] = test_now_ns();
+		if (write(d19.peer[i], &sent[i], sizeof(sent[i])) != sizeof(sent[i])) { _exit(1); }
+	}
+
+	while ((now = test_now_ns()) < end) {
+		int n = epoll_wait(ep, ev, d19.conns, T19_POLL_MS);
+
+		for (int e = 0; e < n; ++e) {
+			int i = ev[e].data.u32;
+			long long echo;
+
+			if (recv(d19.peer[i], &echo, sizeof(echo), MSG_WAITALL) != sizeof(echo)) { _exit(1); }
+			now = test_now_ns();
+			if (echo != sent[i]) { ++d19.shared->bad; }
+			if (echo >= warm) {
+				++d19.shared->requests;
+				if (d19.shared->lat_count < T19_MAX_LAT) {
+					d19.shared->lat[d19.shared->lat_count++] = now - echo;
+				}
+			}
+			sent[i] = now;
+			if (write(d19.peer[i], &sent[i], sizeof(sent[i])) != sizeof(sent[i])) { _exit(1); }
+		}
+	}
+
+	// Collect the last echoes; closing our ends then lets the workers see EOF
+	for (int i = 0; i < d19.conns; ++i) {
+		long long echo;
+		if (recv(d19.peer[i], &echo, sizeof(echo), MSG_WAITALL) != sizeof(echo)) { _exit(1); }
+		close(d19.peer[i]);
+	}
+	_exit(0);
+}
+
+static int t19_cmp(const void *a, const void *b) {
+	long long x = *(const long long *) a, y = *(const long long *) b;
+	return (x > y) - (x < y);
+}
+
+void event_loop() {
+	struct epoll_event ev[MAXTHREADS];
+	int ep, status;
+	pid_t pid;
+
+	MyInitThreads();
+	d19.conns = TEST_PARAM();
+	d19.shared = mmap(NULL, sizeof(*d19.shared), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (!TEST_CHECK(d19.shared != MAP_FAILED)) { MyExitThread(); }
+
+	for (int i = 0; i < d19.conns; ++i) {
+		int sv[2];
+		if (!TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0)) {
+			MyExitThread();
+		}
+		d19.fd[i] = sv[0];
+		d19.peer[i] = sv[1];
+	}
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0) {
+		// The generator blocks; only the server side is non-blocking
+		for (int i = 0; i < d19.conns; ++i) {
+			close(d19.fd[i]);
+			fcntl(d19.peer[i], F_SETFL, 0);
+		}
+		t19_client();
+	}
+	if (!TEST_CHECK(pid != -1)) { MyExitThread(); }
+	for (int i = 0; i < d19.conns; ++i) { close(d19.peer[i]); }
+
+	ep = epoll_create1(0);
+	TEST_CHECK(ep != -1);
+	for (int i = 0; i < d19.conns; ++i) {
+		struct epoll_event e = { .events = EPOLLIN, .data.u32 = i };
+		d19.tid[i] = MyCreateThread(t19_worker, i);
+		TEST_CHECK(d19.tid[i] != -1);
+		TEST_CHECK(epoll_ctl(ep, EPOLL_CTL_ADD, d19.fd[i], &e) == 0);
+	}
+	d19.open = d19.conns;
+
+	// Poll until the generator is done and every worker has exited
+	while (d19.open > 0 && d19.failed == 0) {
+		int n = epoll_wait(ep, ev, d19.conns, T19_POLL_MS);
+
+		if (n == -1 && errno != EINTR) { ++d19.failed; break; }
+		for (int e = 0; e < n; ++e) {
+			int i = ev[e].data.u32;
+			if (d19.closed[i]) { continue; }
+			++d19.yields;
+			if (MyYieldThread(d19.tid[i]) == -1) { ++d19.failed; }
+		}
+	}
+	close(ep);
+
+	TEST_CHECK(waitpid(pid, &status, 0) == pid);
+	TEST_CHECK_(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+			"the load generator failed");
+	TEST_CHECK_(d19.failed == 0, "%d I/O calls or yields failed", d19.failed);
+	TEST_CHECK_(d19.shared->bad == 0, "%lld echoes did not match their request",
+			d19.shared->bad);
+
+	if (TEST_CHECK(d19.shared->lat_count > 0)) {
+		long long n = d19.shared->lat_count;
+		double rate = d19.shared->requests * 1e9 / T19_RUN_NS;
+
+		qsort(d19.shared->lat, n, sizeof(long long), t19_cmp);
+		TEST_RESULT("bench request: %.1f ns/op (%.0f requests/s)", 1e9 / rate, rate);
+		TEST_RESULT("latency: p50 %.1f us, p99 %.1f us, max %.1f us",
+				d19.shared->lat[n / 2] / 1e3, d19.shared->lat[n * 99 / 100] / 1e3,
+				d19.shared->lat[n - 1] / 1e3);
+		TEST_RESULT("switches: %.2f yields and %.2f scheds per request",
+				(double) d19.yields / d19.served, (double) d19.scheds / d19.served);
+	}
+	MyExitThread();
+}
@@ -0,0 +1,63 @@
+#include "bench.h"
+
+/**
+ * Benchmark: cost of each kernel call on its own.
+ *
+ *   get              MyGetThread()
+ *   yield/self       yield to the running thread (no switch)
+ *   yield/invalid    yield to an inactive ID (error path)
+ *   yield/switch     one switch of a ping-pong between two threads
+ *   sched/switch     the same, through MySchedThread()
+ *   create_exit      create a thread, switch to it, and let it exit
+ */
+
+static struct {
+	int done, failed;
+} d18;
+
+static void t18_bounce(int t) {
+	while (!d18.done) {
+		if (MyYieldThread(t) == -1) { ++d18.failed; }
+	}
+}
+
+static void t18_sched(int _) {
+	(void) _;
+	while (!d18.done) { MySchedThread(); }
+}
+
+static void t18_exit(int _) {
+	(void) _;
+}
+
+void kernel_calls() {
+	int t;
+
+	MyInitThreads();
+
+	BENCH("get") { BENCH_DO_NOT_OPTIMIZE(MyGetThread()); }
+	BENCH("yield/self") { MyYieldThread(0); }
+	BENCH("yield/invalid") { MyYieldThread(MAXTHREADS - 1); }
+
+	d18.done = 0;
+	t = MyCreateThread(t18_bounce, 0);
+	TEST_CHECK(t != -1);
+	BENCH_OPS(2, "yield/switch") { MyYieldThread(t); }
+	d18.done = 1;
+	MyYieldThread(t);
+
+	d18.done = 0;
+	t = MyCreateThread(t18_sched, 0);
+	TEST_CHECK(t != -1);
+	BENCH_OPS(2, "sched/switch") { MySchedThread(); }
+	d18.done = 1;
+	MyYieldThread(t);
+
+	BENCH("create_exit") {
+		if (!TEST_CHECK((t = MyCreateThread(t18_exit, 0)) != -1)) { break; }
+		MyYieldThread(t);
+	}
+
+	TEST_CHECK_(d18.failed == 0, "%d yields in the ping-pong failed", d18.failed);
+	MyExitThread();
+}
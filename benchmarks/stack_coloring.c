@@ -0,0 +1,125 @@
+#include <stdint.h>
+#include "bench.h"
+
+/**
+ * Benchmark: cache-set aliasing of thread stacks.
+ *
+ * Stacks carved at a fixed STACKSIZE stride put every thread's top frames at
+ * the same offset modulo the cache way size, so the hot frames of all
+ * threads compete for the same cache sets. A ring of workers each touch a
+ * hot frame of a few KiB and yield to the next worker, the last one back to
+ * T0. The benchmark reports where each worker's hot frame lies, flags
+ * workers whose frames start in the same L1/L2 set, and compares the switch
+ * cost of the plain layout with a "colored" one, where worker i first moves
+ * its stack down by i times the hot frame size so that the hot frames fall
+ * into different sets.
+ *
+ * The cache geometry below is typical (32 KiB 8-way L1, 1 MiB 16-way L2,
+ * 64-byte lines); only the spans matter for the set of an address.
+ */
+
+#define T15_LINE     64
+#define T15_L1_SPAN  4096	// L1 size / ways
+#define T15_L2_SPAN  65536	// L2 size / ways
+#define T15_MAX_HOT  4096
+#define T15_WORKERS  (MAXTHREADS - 1)
+
+static const int t15_hot_sizes[] = { 512, 1024, 2048, T15_MAX_HOT };
+
+static struct {
+	int hot, colored, done, failed;
+	int ring[T15_WORKERS];
+	unsigned char *frame[T15_WORKERS];
+} d15;
+
+static void t15_touch(volatile unsigned char *hot, int bytes) {
+	for (int i = 0; i < bytes; i += T15_LINE) { ++hot[i]; }
+}
+
+static __attribute__((noinline)) void t15_hot(int i) {
+	unsigned char hot[T15_MAX_HOT];
+	int next = (i + 1 < T15_WORKERS) ? d15.ring[i + 1] : 0;
+
+	d15.frame[i] = hot;
+	while (!d15.done) {
+		t15_touch(hot, d15.hot);
+		if (MyYieldThread(next) == -1) { ++d15.failed; }
+	}
+}
+
+static void t15_func(int i) {
+	if (d15.colored) {
+		// Move this worker's hot frame down by i hot frames
+		volatile unsigned char pad[i * d15.hot + 1];
+		pad[0] = 0;
+		t15_hot(i);
+		(void) pad[0];	// a volatile read: pad lives until t15_hot() returns
+	} else {
+		t15_hot(i);
+	}
+}
+
+// Run the ring; returns the cost per worker step in ns
+static double t15_run(int hot, int colored) {
+	d15.hot = hot;
+	d15.colored = colored;
+	d15.done = 0;
+	for (int i = 0; i < T15_WORKERS; ++i) {
+		d15.ring[i] = MyCreateThread(t15_func, i);
+		TEST_CHECK(d15.ring[i] != -1);
+	}
+	BENCH_OPS(T15_WORKERS, "%s/hot=%d", colored ? "colored" : "plain", hot) {
+		MyYieldThread(d15.ring[0]);
+	}
+
+	// Let the workers exit
+	d15.done = 1;
+	for (int i = 0; i < T15_WORKERS; ++i) { MyYieldThread(d15.ring[i]); }
+	return BENCH_NS();
+}
+
+// Report the hot frames of the last run, and how many workers' frames start
+// in the same set as another worker's frame
+static void t15_report_sets(const char *layout) {
+	int l1_alias = 0, l2_alias = 0;
+
+	for (int i = 0; i < T15_WORKERS; ++i) {
+		uintptr_t a = (uintptr_t) d15.frame[i];
+		int l1 = 0, l2 = 0;
+		for (int j = 0; j < T15_WORKERS; ++j) {
+			uintptr_t b = (uintptr_t) d15.frame[j];
+			if (j == i) { continue; }
+			l1 |= (a % T15_L1_SPAN) / T15_LINE == (b % T15_L1_SPAN) / T15_LINE;
+			l2 |= (a % T15_L2_SPAN) / T15_LINE == (b % T15_L2_SPAN) / T15_LINE;
+		}
+		l1_alias += l1;
+		l2_alias += l2;
+		TEST_RESULT("%s: T%d hot frame %p: L1 set %2d, L2 set %4d%s", layout,
+				d15.ring[i], (void *) d15.frame[i],
+				(int) ((a % T15_L1_SPAN) / T15_LINE),
+				(int) ((a % T15_L2_SPAN) / T15_LINE),
+				l2 ? "  (aliased)" : l1 ? "  (aliased in L1)" : "");
+	}
+	TEST_RESULT("%s: %d of %d workers share their L1 set, %d their L2 set",
+			layout, l1_alias, T15_WORKERS, l2_alias);
+}
+
+void stack_coloring() {
+	MyInitThreads();
+
+	for (unsigned s = 0; s < sizeof(t15_hot_sizes) / sizeof(t15_hot_sizes[0]); ++s) {
+		int hot = t15_hot_sizes[s];
+		double plain = t15_run(hot, 0);
+		double colored;
+
+		// Show both layouts with the smallest hot frame
+		if (s == 0) { t15_report_sets("plain"); }
+		colored = t15_run(hot, 1);
+		if (s == 0) { t15_report_sets("colored"); }
+
+		TEST_RESULT("colored/hot=%d: %+.1f%% vs plain", hot,
+				100.0 * (colored - plain) / plain);
+	}
+	TEST_CHECK_(d15.failed == 0, "%d yields in the ring failed", d15.failed);
+	MyExitThread();
+}
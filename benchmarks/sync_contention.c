@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include "bench.h"
+
+// Count the switches of sync.h, and of the spin loops below, per operation
+static long long d22_switches;
+#define SYNC_YIELD(t) (++d22_switches, MyYieldThread(t))
+#define SYNC_SCHED()  (++d22_switches, MySchedThread())
+
+#include "../sync.h"
+
+/**
+ * Benchmark: the primitives of sync.h under contention, against the
+ * busy-yield loops they replace, with `threads` threads (T0 included).
+ *
+ *   mutex/...   every thread repeatedly takes a lock and switches while
+ *               holding it (MySchedThread()), so the others contend. "spin"
+ *               is `while (locked) MySchedThread();`. The bench line is per
+ *               critical section of T0; the result line shows the cost per
+ *               section of any thread, and T0's share (a spin lock lets the
+ *               releasing thread take it straight back).
+ *   sem/...     T0 hands a unit of work to each worker and waits until all
+ *               are done, through semaphores or through spinning on flags.
+ *               Per unit of work.
+ *   chan/cap=N  the workers send to T0 through a channel of capacity N.
+ *               Per value received.
+ *
+ * Each result line also shows the switches (yields and scheds) per
+ * operation. Since a release yields straight to the woken waiter, and a
+ * waiter straight to the thread that can wake it, they stay the same for
+ * the primitives of sync.h however many threads wait, while the spin lock
+ * polls every waiter in turn.
+ */
+
+TEST_PARAMS(sync_contention, "threads", 2, MAXTHREADS);
+
+static struct {
+	int workers, done, running, spin, spin_done;
+	long long sections, t0_sections, switches;
+	Mutex m;
+	Sem work[MAXTHREADS], all_done;
+	int flag[MAXTHREADS];
+	Chan chan;
+} d22;
+
+static void t22_mutex_section() {
+	MutexLock(&d22.m);
+	++d22.sections;
+	SYNC_SCHED();
+	MutexUnlock(&d22.m);
+}
+
+static void t22_spin_section() {
+	while (d22.spin) { SYNC_SCHED(); }
+	d22.spin = 1;
+	++d22.sections;
+	SYNC_SCHED();
+	d22.spin = 0;
+}
+
+static void t22_mutex_worker(int spin) {
+	while (!d22.done) {
+		if (spin) { t22_spin_section(); } else { t22_mutex_section(); }
+	}
+	--d22.running;
+}
+
+static void t22_sem_worker(int i) {
+	for (;;) {
+		SemWait(&d22.work[i]);
+		if (d22.done) { break; }
+		++d22.sections;
+		SemPost(&d22.all_done);
+	}
+	--d22.running;
+}
+
+static void t22_flag_worker(int i) {
+	while (!d22.done) {
+		while (!d22.flag[i] && !d22.done) { SYNC_SCHED(); }
+		if (d22.done) { break; }
+		d22.flag[i] = 0;
+		++d22.sections;
+		++d22.spin_done;
+	}
+	--d22.running;
+}
+
+static void t22_chan_worker(int i) {
+	while (ChanSend(&d22.chan, (void *) (intptr_t) i) == 0) { }
+	--d22.running;
+}
+
+static void t22_start(void (*func)(int), int arg_is_index, int arg) {
+	d22.done = 0;
+	d22.running = d22.workers;
+	d22.sections = d22.t0_sections = 0;
+	d22_switches = 0;
+	for (int i = 0; i < d22.workers; ++i) {
+		TEST_CHECK(MyCreateThread(func, arg_is_index ? i : arg) != -1);
+	}
+}
+
+// Stop counting switches, which until now were all for the operations
+static void t22_stop() {
+	d22.switches = d22_switches;
+	d22.done = 1;
+}
+
+// Wait until the workers, once released by the caller, have exited
+static void t22_finish() {
+	while (d22.running > 0) { MySchedThread(); }
+}
+
+static void t22_result(const char *name) {
+	if (TEST_CHECK(d22.sections > 0)) {
+		TEST_RESULT("%s: %.2f switches per op", name,
+				(double) d22.switches / d22.sections);
+	}
+}
+
+static void t22_contend(int spin) {
+	MutexInit(&d22.m);
+	d22.spin = 0;
+	t22_start(t22_mutex_worker, 0, spin);
+	BENCH("mutex/%s", spin ? "spin" : "handoff") {
+		if (spin) { t22_spin_section(); } else { t22_mutex_section(); }
+		++d22.t0_sections;
+	}
+	t22_stop();
+	t22_finish();
+
+	if (TEST_CHECK(d22.sections > 0)) {
+		double share = (double) d22.t0_sections / d22.sections;
+		TEST_RESULT("mutex/%s: %.1f ns per section, %.0f%% of them by T0, "
+				"%.2f switches each", spin ? "spin" : "handoff",
+				BENCH_NS() * share, 100.0 * share,
+				(double) d22.switches / d22.sections);
+	}
+}
+
+void sync_contention() {
+	char name[32];
+	void *v;
+
+	MyInitThreads();
+	d22.workers = TEST_PARAM() - 1;
+
+	t22_contend(0);
+	t22_contend(1);
+
+	SemInit(&d22.all_done, 0);
+	for (int i = 0; i < d22.workers; ++i) { SemInit(&d22.work[i], 0); }
+	t22_start(t22_sem_worker, 1, 0);
+	BENCH_OPS(d22.workers, "sem/handoff") {
+		for (int i = 0; i < d22.workers; ++i) { SemPost(&d22.work[i]); }
+		for (int i = 0; i < d22.workers; ++i) { SemWait(&d22.all_done); }
+	}
+	t22_stop();
+	for (int i = 0; i < d22.workers; ++i) { SemPost(&d22.work[i]); }
+	t22_finish();
+	t22_result("sem/handoff");
+
+	t22_start(t22_flag_worker, 1, 0);
+	BENCH_OPS(d22.workers, "sem/spin") {
+		d22.spin_done = 0;
+		for (int i = 0; i < d22.workers; ++i) { d22.flag[i] = 1; }
+		while (d22.spin_done < d22.workers) { SYNC_SCHED(); }
+	}
+	t22_stop();
+	t22_finish();
+	t22_result("sem/spin");
+
+	for (int cap = 1; cap <= CHAN_MAX; cap *= 8) {
+		ChanInit(&d22.chan, cap);
+		t22_start(t22_chan_worker, 1, 0);
+		BENCH("chan/cap=%d", cap) {
+			if (!TEST_CHECK(ChanRecv(&d22.chan, &v) == 0)) { break; }
+			++d22.sections;
+		}
+		t22_stop();
+		ChanClose(&d22.chan);
+		t22_finish();
+		snprintf(name, sizeof(name), "chan/cap=%d", cap);
+		t22_result(name);
+	}
+	MyExitThread();
+}
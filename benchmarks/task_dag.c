@@ -0,0 +1,432 @@
+#include <stdlib.h>
+#include "bench.h"
+
+/**
+ * Benchmark: a fork-join task graph executed by a pool of MAXTHREADS
+ * threads (T0 included), as task granularity shrinks.
+ *
+ *   qsort/grain=G   parallel quicksort of T27_SORT_N ints: a task partitions
+ *                   its range, spawns a task for each half, runs the first
+ *                   itself and joins the second; ranges of at most G
+ *                   elements are sorted in the task
+ *   matmul/tile=T   C = A B for T27_MAT_N x T27_MAT_N matrices, in T x T
+ *                   tiles: task (i, j, k) adds A(i, k) B(k, j) to C(i, j),
+ *                   and depends on task (i, j, k - 1)
+ *
+ * Workers run ready tasks, oldest first, and take turns: a worker that
+ * finishes a task hands control to an idle one while tasks are ready. A
+ * task joining children that are not done parks its worker, which hands
+ * control to a parked worker whose children are done, or else to an idle
+ * worker if tasks are ready; only when no worker can take over does it run
+ * ready tasks itself, newest first. All hand-offs are MyYieldThread() calls.
+ * So matmul hands off about once per task, while qsort, once its workers
+ * are parked in the top joins of the tree, runs most of a fine-grained sort
+ * inline and hands off little.
+ *
+ * Each size reports the time per task, in the format of BENCH, with tasks
+ * per second, yields per task, and the scheduling overhead: the share of the
+ * run not spent in the same work done serially (the fastest of T27_REPS runs
+ * each). The smallest size whose overhead is under T27_PROFITABLE is the
+ * finest granularity worth scheduling as tasks.
+ */
+
+#define T27_SORT_N     (1 << 18)
+#define T27_MAT_N      128
+#define T27_MAX_TASKS  (1 << 17)
+#define T27_REPS       3
+#define T27_PROFITABLE 0.5
+
+static const int t27_grains[] = { 65536, 16384, 4096, 1024, 256, 64, 16 };
+static const int t27_tiles[] = { 64, 32, 16, 8, 4 };
+
+struct t27_task {
+	void (*fn)(struct t27_task *);
+	struct t27_task *parent;	// joins this task, or NULL
+	struct t27_task *succ;		// depends on this task, or NULL
+	int pending;			// children not done, or predecessors
+	int waiter;			// worker parked joining this task, or -1
+	int a, b, c;			// arguments
+};
+
+static struct {
+	int tid[MAXTHREADS];		// kernel ID of each worker
+	int cur;			// the running worker
+	int parked[MAXTHREADS];
+	int idle[MAXTHREADS], nidle;	// workers with nothing to run
+	int resume[MAXTHREADS], nresume;// parked workers whose children are done
+	struct t27_task *ready[T27_MAX_TASKS];
+	int head, len;
+	struct t27_task tasks[T27_MAX_TASKS];
+	int ntasks, overflow, shutdown;
+	long long yields;
+
+	int grain, tile;
+	int *sort;
+	double *ma, *mb, *mc, *mref;
+} d27;
+
+static struct t27_task *t27_new(void (*fn)(struct t27_task *), int a, int b, int c) {
+	struct t27_task *t;
+
+	if (d27.ntasks == T27_MAX_TASKS) {
+		d27.overflow = 1;
+		t = &d27.tasks[0];	// results are wrong, and the check fails
+	} else {
+		t = &d27.tasks[d27.ntasks++];
+	}
+	t->fn = fn;
+	t->parent = t->succ = NULL;
+	t->pending = 0;
+	t->waiter = -1;
+	t->a = a;
+	t->b = b;
+	t->c = c;
+	return t;
+}
+
+static void t27_push(struct t27_task *t) {
+	d27.ready[(d27.head + d27.len++) % T27_MAX_TASKS] = t;
+}
+
+// The oldest ready task, for a worker that takes work, or NULL
+static struct t27_task *t27_pop() {
+	struct t27_task *t;
+
+	if (d27.len == 0) { return NULL; }
+	t = d27.ready[d27.head];
+	d27.head = (d27.head + 1) % T27_MAX_TASKS;
+	--d27.len;
+	return t;
+}
+
+// The newest ready task, for a join that runs tasks itself, or NULL: the
+// children of the joining task, so that the nesting of joins on the stack
+// follows the graph instead of growing with the whole queue
+static struct t27_task *t27_pop_newest() {
+	if (d27.len == 0) { return NULL; }
+	--d27.len;
+	return d27.ready[(d27.head + d27.len) % T27_MAX_TASKS];
+}
+
+// Hand control to worker w; returns when another worker hands it back
+static void t27_yield(int w) {
+	int me = d27.cur;
+
+	++d27.yields;
+	MyYieldThread(d27.tid[w]);
+	d27.cur = me;
+}
+
+static void t27_run(struct t27_task *t) {
+	struct t27_task *p = t->parent, *s = t->succ;
+
+	t->fn(t);
+	if (s != NULL && --s->pending == 0) { t27_push(s); }
+	if (p != NULL && --p->pending == 0 && p->waiter >= 0 && d27.parked[p->waiter]) {
+		d27.resume[d27.nresume++] = p->waiter;
+	}
+}
+
+// Wait until the children of t are done
+static void t27_join(struct t27_task *t) {
+	int me = d27.cur;
+
+	while (t->pending > 0) {
+		struct t27_task *r;
+		int to;
+
+		if (d27.nresume > 0) {
+			to = d27.resume[--d27.nresume];
+		} else if (d27.len > 0 && d27.nidle > 0) {
+			to = d27.idle[--d27.nidle];
+		} else if ((r = t27_pop_newest()) != NULL) {
+			t27_run(r);
+			continue;
+		} else {
+			TEST_CHECK_(0, "no worker can make progress");
+			return;
+		}
+		t->waiter = me;
+		d27.parked[me] = 1;
+		t27_yield(to);
+		d27.parked[me] = 0;
+	}
+}
+
+static void t27_worker(int me) {
+	d27.cur = me;
+	for (;;) {
+		struct t27_task *t;
+
+		if (d27.nresume == 0 && (t = t27_pop()) != NULL) {
+			t27_run(t);
+			if (d27.len == 0 || d27.nidle == 0) { continue; }
+		}
+		if (d27.shutdown) { return; }
+		if (d27.nresume > 0) {
+			d27.idle[d27.nidle++] = me;
+			t27_yield(d27.resume[--d27.nresume]);
+		} else if (d27.len > 0 && d27.nidle > 0) {
+			// Take turns with the other workers
+			int to = d27.idle[--d27.nidle];
+
+			d27.idle[d27.nidle++] = me;
+			t27_yield(to);
+		} else {
+			d27.idle[d27.nidle++] = me;
+			TEST_CHECK_(0, "worker %d has no worker to hand control to", me);
+			t27_yield(0);
+		}
+	}
+}
+
+// Run the graph below root, with T0 as one of the workers
+static void t27_execute(struct t27_task *root) {
+	struct t27_task done = { 0 };
+
+	done.pending = 1;
+	done.waiter = -1;
+	root->parent = &done;
+	t27_push(root);
+	t27_join(&done);
+}
+
+/* Quicksort */
+
+static void t27_swap(int *x, int *y) {
+	int t = *x;
+	*x = *y;
+	*y = t;
+}
+
+// Partition a[lo, hi) around the median of three; returns the split
+static int t27_partition(int *a, int lo, int hi) {
+	int mid = lo + (hi - 1 - lo) / 2, i = lo - 1, j = hi, pivot;
+
+	if (a[mid] < a[lo]) { t27_swap(&a[mid], &a[lo]); }
+	if (a[hi - 1] < a[lo]) { t27_swap(&a[hi - 1], &a[lo]); }
+	if (a[hi - 1] < a[mid]) { t27_swap(&a[hi - 1], &a[mid]); }
+	pivot = a[mid];
+	for (;;) {
+		do { ++i; } while (a[i] < pivot);
+		do { --j; } while (a[j] > pivot);
+		if (i >= j) { return j + 1; }
+		t27_swap(&a[i], &a[j]);
+	}
+}
+
+static void t27_sort_serial(int *a, int lo, int hi) {
+	while (hi - lo > 16) {
+		int split = t27_partition(a, lo, hi);
+
+		t27_sort_serial(a, lo, split);
+		lo = split;
+	}
+	for (int i = lo + 1; i < hi; ++i) {
+		int v = a[i], j = i;
+
+		for (; j > lo && a[j - 1] > v; --j) { a[j] = a[j - 1]; }
+		a[j] = v;
+	}
+}
+
+static void t27_sort_task(struct t27_task *t) {
+	int lo = t->a, hi = t->b, split;
+	struct t27_task *left, *right;
+
+	if (hi - lo <= d27.grain) {
+		t27_sort_serial(d27.sort, lo, hi);
+		return;
+	}
+	split = t27_partition(d27.sort, lo, hi);
+	left = t27_new(t27_sort_task, lo, split, 0);
+	right = t27_new(t27_sort_task, split, hi, 0);
+	left->parent = right->parent = t;
+	t->pending += 2;
+	t27_push(right);
+	t27_run(left);
+	t27_join(t);
+}
+
+static void t27_sort_fill() {
+	unsigned seed = 27;
+
+	for (int i = 0; i < T27_SORT_N; ++i) { d27.sort[i] = rand_r(&seed); }
+}
+
+static void t27_sort_dag() {
+	t27_execute(t27_new(t27_sort_task, 0, T27_SORT_N, 0));
+}
+
+static void t27_sort_ref() {
+	t27_sort_serial(d27.sort, 0, T27_SORT_N);
+}
+
+static int t27_sort_check() {
+	for (int i = 1; i < T27_SORT_N; ++i) {
+		if (d27.sort[i - 1] > d27.sort[i]) { return 0; }
+	}
+	return 1;
+}
+
+/* Tiled matrix multiply */
+
+static void t27_tile(int i, int j, int k) {
+	int n = T27_MAT_N, t = d27.tile;
+
+	for (int r = i * t; r < (i + 1) * t; ++r) {
+		for (int x = k * t; x < (k + 1) * t; ++x) {
+			double v = d27.ma[r * n + x];
+
+			for (int c = j * t; c < (j + 1) * t; ++c) {
+				d27.mc[r * n + c] += v * d27.mb[x * n + c];
+			}
+		}
+	}
+}
+
+static void t27_tile_task(struct t27_task *t) {
+	t27_tile(t->a, t->b, t->c);
+}
+
+static void t27_mat_root(struct t27_task *root) {
+	int nt = T27_MAT_N / d27.tile;
+
+	for (int i = 0; i < nt; ++i) {
+		for (int j = 0; j < nt; ++j) {
+			struct t27_task *prev = NULL;
+
+			for (int k = 0; k < nt; ++k) {
+				struct t27_task *t = t27_new(t27_tile_task, i, j, k);
+
+				if (prev == NULL) {
+					t27_push(t);
+				} else {
+					prev->succ = t;
+					t->pending = 1;
+				}
+				prev = t;
+			}
+			prev->parent = root;
+			++root->pending;
+		}
+	}
+	t27_join(root);
+}
+
+static void t27_mat_fill() {
+	unsigned seed = 27;
+
+	for (int i = 0; i < T27_MAT_N * T27_MAT_N; ++i) {
+		d27.ma[i] = rand_r(&seed) % 100 / 10.0;
+		d27.mb[i] = rand_r(&seed) % 100 / 10.0;
+		d27.mc[i] = 0.0;
+	}
+}
+
+static void t27_mat_dag() {
+	t27_execute(t27_new(t27_mat_root, 0, 0, 0));
+}
+
+static void t27_mat_ref() {
+	int nt = T27_MAT_N / d27.tile;
+
+	for (int i = 0; i < nt; ++i) {
+		for (int j = 0; j < nt; ++j) {
+			for (int k = 0; k < nt; ++k) { t27_tile(i, j, k); }
+		}
+	}
+}
+
+static int t27_mat_check() {
+	return memcmp(d27.mc, d27.mref, T27_MAT_N * T27_MAT_N * sizeof(double)) == 0;
+}
+
+/* Driver */
+
+// The fastest of T27_REPS runs of fill() then run(), in ns, without fill()
+static long long t27_time(void (*fill)(), void (*run)()) {
+	long long best = 0;
+
+	for (int rep = 0; rep < T27_REPS; ++rep) {
+		long long start;
+
+		fill();
+		d27.ntasks = 0;
+		d27.yields = 0;
+		start = test_now_ns();
+		run();
+		start = test_now_ns() - start;
+		if (rep == 0 || start < best) { best = start; }
+	}
+	return best;
+}
+
+// Time one workload at one size, and report it; returns its overhead
+static double t27_measure(const char *name, void (*fill)(), void (*dag)(),
+		void (*ref)(), int (*check)()) {
+	long long serial = t27_time(fill, ref), ns = t27_time(fill, dag);
+	double overhead = (double) (ns - serial) / ns;
+
+	TEST_CHECK_(check() && !d27.overflow, "%s computed a wrong result", name);
+	TEST_RESULT("bench %s: %.1f ns/op (%d tasks, %.0f tasks/s, %.2f yields/task, "
+			"overhead %.1f%%)", name, (double) ns / d27.ntasks, d27.ntasks,
+			d27.ntasks * 1e9 / ns, (double) d27.yields / d27.ntasks,
+			100.0 * overhead);
+	return overhead;
+}
+
+void task_dag() {
+	char name[64];
+	int best;
+
+	MyInitThreads();
+	d27.tid[0] = MyGetThread();
+	for (int w = 1; w < MAXTHREADS; ++w) {
+		d27.tid[w] = MyCreateThread(t27_worker, w);
+		TEST_CHECK(d27.tid[w] != -1);
+		// Let it start and wait in the idle list
+		d27.cur = 0;
+		d27.resume[d27.nresume++] = 0;
+		t27_yield(w);
+	}
+
+	d27.sort = malloc(T27_SORT_N * sizeof(int));
+	best = 0;
+	for (unsigned g = 0; g < sizeof(t27_grains) / sizeof(t27_grains[0]); ++g) {
+		d27.grain = t27_grains[g];
+		snprintf(name, sizeof(name), "qsort/grain=%d", d27.grain);
+		if (t27_measure(name, t27_sort_fill, t27_sort_dag, t27_sort_ref,
+					t27_sort_check) < T27_PROFITABLE) {
+			best = d27.grain;
+		}
+	}
+	TEST_RESULT("qsort: smallest grain with overhead under %.0f%%: %d",
+			100.0 * T27_PROFITABLE, best);
+
+	d27.ma = malloc(4 * T27_MAT_N * T27_MAT_N * sizeof(double));
+	d27.mb = d27.ma + T27_MAT_N * T27_MAT_N;
+	d27.mc = d27.mb + T27_MAT_N * T27_MAT_N;
+	d27.mref = d27.mc + T27_MAT_N * T27_MAT_N;
+	best = 0;
+	for (unsigned t = 0; t < sizeof(t27_tiles) / sizeof(t27_tiles[0]); ++t) {
+		d27.tile = t27_tiles[t];
+		t27_mat_fill();
+		t27_mat_ref();
+		memcpy(d27.mref, d27.mc, T27_MAT_N * T27_MAT_N * sizeof(double));
+		snprintf(name, sizeof(name), "matmul/tile=%d", d27.tile);
+		if (t27_measure(name, t27_mat_fill, t27_mat_dag, t27_mat_ref,
+					t27_mat_check) < T27_PROFITABLE) {
+			best = d27.tile;
+		}
+	}
+	TEST_RESULT("matmul: smallest tile with overhead under %.0f%%: %d",
+			100.0 * T27_PROFITABLE, best);
+
+	// Let the workers exit
+	d27.shutdown = 1;
+	while (d27.nidle > 0) { MyYieldThread(d27.tid[d27.idle[--d27.nidle]]); }
+	free(d27.sort);
+	free(d27.ma);
+	MyExitThread();
+}
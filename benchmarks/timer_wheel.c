@@ -0,0 +1,154 @@
+#include "bench.h"
+#include "../timer.h"
+
+/**
+ * Benchmark: sleeping with timer.h.
+ *
+ *   accuracy     T0 alone sleeps T24_REPS times for each duration; reports
+ *                how late it woke (median, p99 and max) and the CPU time
+ *                used per wall time, which should be near 0.
+ *   sched/...    the cost for T0 to get the CPU back from an awake partner
+ *                thread with 0 to MAXTHREADS - 2 other threads asleep, with
+ *                TimerSchedThread() (which skips the sleepers) and with
+ *                MySchedThread() (which lets the kernel run them, to pass
+ *                the CPU on at once).
+ *   periodic     every thread but T0 sleeps 1 ms at a time for T24_PERIOD_NS,
+ *                with TimerSleep() and with a `MySchedThread()` loop until
+ *                the deadline; reports wakeups per second, lateness and CPU.
+ */
+
+#define T24_REPS       50
+#define T24_PERIOD_NS  100000000LL	// 100 ms
+#define T24_TICK_NS    1000000LL	// period of the periodic sleepers
+
+static const long long t24_sleeps[] = { 20000, 100000, 1000000, 5000000 };
+
+static struct {
+	int done, running, plain, spin;
+	long long end, wakeups, late;
+	long long lat[T24_REPS];
+} d24;
+
+static long long t24_cpu_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int t24_cmp(const void *a, const void *b) {
+	long long x = *(const long long *) a, y = *(const long long *) b;
+	return (x > y) - (x < y);
+}
+
+static void t24_accuracy(long long ns) {
+	long long wall = TimerNow(), cpu = t24_cpu_ns();
+
+	for (int r = 0; r < T24_REPS; ++r) {
+		long long deadline = TimerNow() + ns;
+		TimerSleepUntil(deadline);
+		d24.lat[r] = TimerNow() - deadline;
+	}
+	wall = TimerNow() - wall;
+	cpu = t24_cpu_ns() - cpu;
+	qsort(d24.lat, T24_REPS, sizeof(d24.lat[0]), t24_cmp);
+	TEST_RESULT("accuracy/%lldus: late p50 %.1f us, p99 %.1f us, max %.1f us; cpu %.1f%%",
+			ns / 1000, d24.lat[T24_REPS / 2] / 1e3, d24.lat[T24_REPS * 99 / 100] / 1e3,
+			d24.lat[T24_REPS - 1] / 1e3, 100.0 * cpu / wall);
+	TEST_CHECK(d24.lat[0] >= 0);
+}
+
+static void t24_sleeper(int _) {
+	(void) _;
+	TimerSleep(3600 * 1000000000LL);	// until woken
+	--d24.running;
+}
+
+static void t24_partner(int _) {
+	(void) _;
+	while (!d24.done) {
+		if (d24.plain) { MySchedThread(); } else { TimerSchedThread(); }
+	}
+	--d24.running;
+}
+
+static void t24_sched(int sleepers, int plain) {
+	int t[MAXTHREADS];
+
+	d24.done = 0;
+	d24.plain = plain;
+	d24.running = sleepers + 1;
+	for (int i = 0; i < sleepers; ++i) {
+		t[i] = TimerCreateThread(t24_sleeper, 0);
+		TEST_CHECK(t[i] != -1);
+	}
+	TEST_CHECK(TimerCreateThread(t24_partner, 0) != -1);
+	while (TimerSchedThread(), timer__.sleepers < sleepers) { }
+
+	if (plain) {
+		BENCH("sched/plain/sleepers=%d", sleepers) { MySchedThread(); }
+	} else {
+		BENCH("sched/timer/sleepers=%d", sleepers) { TimerSchedThread(); }
+	}
+
+	d24.done = 1;
+	for (int i = 0; i < sleepers; ++i) { TimerWake(t[i]); }
+	while (d24.running > 0) { TimerSchedThread(); }
+}
+
+static void t24_periodic_worker(int _) {
+	long long deadline = TimerNow();
+
+	(void) _;
+	while (deadline + T24_TICK_NS < d24.end) {
+		deadline += T24_TICK_NS;
+		if (d24.spin) {
+			while (TimerNow() < deadline) { MySchedThread(); }
+		} else {
+			TimerSleepUntil(deadline);
+		}
+		d24.late += TimerNow() - deadline;
+		++d24.wakeups;
+	}
+	--d24.running;
+}
+
+static void t24_periodic(int spin) {
+	long long wall = TimerNow(), cpu = t24_cpu_ns();
+
+	d24.spin = spin;
+	d24.wakeups = d24.late = 0;
+	d24.end = wall + T24_PERIOD_NS;
+	d24.running = MAXTHREADS - 1;
+	for (int i = 0; i < MAXTHREADS - 1; ++i) {
+		TEST_CHECK(TimerCreateThread(t24_periodic_worker, 0) != -1);
+	}
+	while (d24.running > 0) {
+		if (spin) { MySchedThread(); } else { TimerSleep(T24_TICK_NS); }
+	}
+	wall = TimerNow() - wall;
+	cpu = t24_cpu_ns() - cpu;
+
+	if (TEST_CHECK(d24.wakeups > 0)) {
+		TEST_RESULT("periodic/%s: %.0f wakeups/s, late %.1f us on average; cpu %.1f%%",
+				spin ? "spin" : "timer", d24.wakeups * 1e9 / wall,
+				d24.late / 1e3 / d24.wakeups, 100.0 * cpu / wall);
+	}
+}
+
+void timer_wheel() {
+	int counts[] = { 0, (MAXTHREADS - 2) / 2, MAXTHREADS - 2 };
+
+	MyInitThreads();
+	TimerInit();
+
+	for (unsigned i = 0; i < sizeof(t24_sleeps) / sizeof(t24_sleeps[0]); ++i) {
+		t24_accuracy(t24_sleeps[i]);
+	}
+	for (unsigned i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+		t24_sched(counts[i], 0);
+		t24_sched(counts[i], 1);
+	}
+	t24_periodic(0);
+	t24_periodic(1);
+	MyExitThread();
+}
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include "bench.h"
+#include "../trace.h"
+
+/**
+ * Benchmark: replaying a trace of kernel calls (see trace.h) as fast as
+ * possible.
+ *
+ * The trace is the file named by the TRACE environment variable, such as
+ * one recorded with `TRACE=all75.trace ./reftrace all75`, or else a
+ * synthetic trace of T25_SYNTH_CALLS calls by up to MAXTHREADS threads,
+ * which yield to each other, schedule, create and exit at random.
+ *
+ * Each thread of the trace is played by a thread running t25_replay(), which
+ * makes the calls of the records tagged with it, in order. Thread IDs are
+ * mapped from those in the trace to those the kernel returns. When the
+ * kernel runs another thread than the one that made the next call in the
+ * trace, the running thread yields to that one: such steers are counted,
+ * and there are none if the kernel schedules like the one recorded (the
+ * synthetic trace follows the FIFO order of the reference kernel). Records
+ * of threads that the kernel failed to create are skipped.
+ *
+ * Reports the time per call replayed, in the format of BENCH, and the
+ * steers and skips.
+ */
+
+#define T25_SYNTH_CALLS 2000000
+
+static struct {
+	TraceReader trace;
+	int map[MAXTHREADS];	// kernel ID of each trace ID, or -1
+	int live;		// threads that have not finished replaying
+	long long start, calls, steers, skipped;
+} d25;
+
+// Write a synthetic trace, following the scheduling of the reference kernel
+static int t25_synthesize(const char *path) {
+	int queue[MAXTHREADS], len = 0, cur = 0, last = 0, valid[MAXTHREADS] = { 1 };
+	unsigned seed = 25;
+	TraceWriter w;
+
+	if (TraceWriterOpen(&w, path) == -1) { return -1; }
+	for (long long n = 0; n < T25_SYNTH_CALLS; ++n) {
+		int r = rand_r(&seed) % 100, t;
+
+		if (r < 8 && len < MAXTHREADS - 1) {
+			// Create: the first free ID after the last one created
+			for (t = (last + 1) % MAXTHREADS; valid[t]; t = (t + 1) % MAXTHREADS);
+			TraceWrite(&w, TRACE_CREATE, cur, t, 0);
+			valid[t] = 1;
+			queue[len++] = last = t;
+		} else if (r < 14 && cur != 0) {
+			// Exit: the head of the queue runs
+			TraceWrite(&w, TRACE_EXIT, cur, 0, 0);
+			valid[cur] = 0;
+			cur = queue[0];
+			memmove(queue, queue + 1, --len * sizeof(queue[0]));
+		} else if (r < 30 || len == 0) {
+			// Sched: the head of the queue runs, and cur goes to its end
+			TraceWrite(&w, TRACE_SCHED, cur, 0, 0);
+			if (len > 0) {
+				t = queue[0];
+				memmove(queue, queue + 1, (len - 1) * sizeof(queue[0]));
+				queue[len - 1] = cur;
+				cur = t;
+			}
+		} else {
+			// Yield to a random other thread, which leaves the queue
+			int k = rand_r(&seed) % len;
+
+			t = queue[k];
+			TraceWrite(&w, TRACE_YIELD, cur, 0, t);
+			memmove(queue + k, queue + k + 1, (len - k - 1) * sizeof(queue[0]));
+			queue[len - 1] = cur;
+			cur = t;
+		}
+	}
+	return TraceWriterClose(&w);
+}
+
+static void t25_replay(int me);
+
+static void t25_finish() {
+	if (--d25.live > 0) { return; }
+	long long ns = test_now_ns() - d25.start;
+	TraceClose(&d25.trace);
+	if (TEST_CHECK(d25.calls > 0)) {
+		TEST_RESULT("bench replay: %.1f ns/op (%lld calls, %.0f calls/s)",
+				(double) ns / d25.calls, d25.calls, d25.calls * 1e9 / ns);
+		TEST_RESULT("replay: %lld steers (%.2f per call), %lld records skipped",
+				d25.steers, (double) d25.steers / d25.calls, d25.skipped);
+	}
+}
+
+// Make the calls of trace thread `me`, until it exits or the trace ends
+static void t25_replay(int me) {
+	const struct TraceRecord *r;
+
+	while ((r = TracePeek(&d25.trace)) != NULL) {
+		int t;
+
+		if (r->tid != me) {
+			if (r->tid >= 0 && r->tid < MAXTHREADS && d25.map[r->tid] != -1) {
+				++d25.steers;
+				MyYieldThread(d25.map[r->tid]);
+			} else {
+				++d25.skipped;
+				TraceNext(&d25.trace);
+			}
+			continue;
+		}
+		TraceNext(&d25.trace);
+		++d25.calls;
+		switch (r->op) {
+		case TRACE_CREATE:
+			t = MyCreateThread(t25_replay, r->ret);
+			if (t != -1) { ++d25.live; }
+			if (r->ret >= 0 && r->ret < MAXTHREADS) { d25.map[r->ret] = t; }
+			break;
+		case TRACE_YIELD:
+			// Yields to invalid and exited IDs stay invalid
+			t = r->arg >= 0 && r->arg < MAXTHREADS ? d25.map[r->arg] : r->arg;
+			MyYieldThread(t);
+			break;
+		case TRACE_SCHED:
+			MySchedThread();
+			break;
+		case TRACE_EXIT:
+			d25.map[me] = -1;
+			t25_finish();
+			MyExitThread();
+			break;
+		}
+	}
+	if (me >= 0 && me < MAXTHREADS && d25.map[me] == MyGetThread()) { d25.map[me] = -1; }
+	t25_finish();
+}
+
+void trace_replay() {
+	const char *path = getenv("TRACE");
+	char synth[] = "/tmp/trace_replay.XXXXXX";
+
+	MyInitThreads();
+	if (path == NULL) {
+		int fd = mkstemp(synth);
+
+		TEST_CHECK_(fd != -1, "cannot create %s", synth);
+		close(fd);
+		TEST_CHECK_(t25_synthesize(synth) == 0, "cannot write %s", synth);
+		path = synth;
+	}
+	if (!TEST_CHECK_(TraceOpen(&d25.trace, path) == 0, "cannot open trace %s: %s",
+				path, strerror(errno))) {
+		MyExitThread();
+	}
+	if (path == synth) { unlink(synth); }	// it stays mapped
+
+	for (int i = 0; i < MAXTHREADS; ++i) { d25.map[i] = -1; }
+	d25.map[0] = MyGetThread();
+	d25.live = 1;
+	d25.start = test_now_ns();
+	t25_replay(0);
+	MyExitThread();
+}
@@ -0,0 +1,96 @@
+#include "bench.h"
+
+/**
+ * Benchmark: cost of a context switch as a function of each thread's stack
+ * working set and of the number of threads.
+ *
+ * T0 creates a ring of worker threads. For each working-set size, each
+ * iteration yields to the first worker; each worker touches that many bytes
+ * of its own stack (one write per cache line) and yields to the next, and
+ * the last one back to T0. The cost per worker step (the touches and a
+ * switch) is reported by BENCH_OPS.
+ *
+ * In each step, a worker times its touches twice over the same frame: the
+ * first pass brings back into the cache what the other threads evicted,
+ * and the second finds it there. So
+ *
+ *   refill = first pass - second pass
+ *
+ * is the cost of refilling the thread's working set after a round of the
+ * ring. When the working sets all fit in the cache, the two passes differ
+ * only by noise, and the refill is reported as 0 rather than below it.
+ */
+
+#define T14_LINE      64
+#define T14_MAX_BYTES (STACKSIZE - 1024)	// leave room for the frames
+
+TEST_PARAMS(working_set, "threads", 2, MAXTHREADS - 1);
+
+static const int t14_sizes[] = {
+	0, 1024, 2048, 4096, 8192, 16384, 32768, T14_MAX_BYTES
+};
+
+static struct {
+	int threads, bytes, done, failed;
+	int ring[MAXTHREADS];
+	long long steps, first_ns, second_ns;	// of the workers' touches
+} d14;
+
+static void t14_touch(volatile unsigned char *ws, int bytes) {
+	for (int i = 0; i < bytes; i += T14_LINE) { ++ws[i]; }
+}
+
+static void t14_func(int i) {
+	unsigned char ws[T14_MAX_BYTES];
+	int next = (i + 1 < d14.threads) ? d14.ring[i + 1] : 0;
+
+	while (!d14.done) {
+		long long start = test_now_ns(), mid, end;
+
+		t14_touch(ws, d14.bytes);
+		mid = test_now_ns();
+		t14_touch(ws, d14.bytes);
+		end = test_now_ns();
+		d14.first_ns += mid - start;
+		d14.second_ns += end - mid;
+		++d14.steps;
+		if (MyYieldThread(next) == -1) { ++d14.failed; }
+	}
+}
+
+// Run the ring with the given working set, and report the refill cost
+static void t14_run(int bytes) {
+	double first, second;
+
+	d14.bytes = bytes;
+	d14.done = 0;
+	d14.steps = d14.first_ns = d14.second_ns = 0;
+	for (int i = 0; i < d14.threads; ++i) {
+		d14.ring[i] = MyCreateThread(t14_func, i);
+		TEST_CHECK(d14.ring[i] != -1);
+	}
+	BENCH_OPS(d14.threads, "step/bytes=%d", bytes) {
+		MyYieldThread(d14.ring[0]);
+	}
+
+	// Let the workers exit
+	d14.done = 1;
+	for (int i = 0; i < d14.threads; ++i) { MyYieldThread(d14.ring[i]); }
+
+	if (!TEST_CHECK(d14.steps > 0)) { return; }
+	first = (double) d14.first_ns / d14.steps;
+	second = (double) d14.second_ns / d14.steps;
+	TEST_RESULT("refill/bytes=%d: %.1f ns (first pass %.1f ns, second %.1f ns)",
+			bytes, first > second ? first - second : 0.0, first, second);
+}
+
+void working_set() {
+	MyInitThreads();
+	d14.threads = TEST_PARAM();
+
+	for (unsigned s = 0; s < sizeof(t14_sizes) / sizeof(t14_sizes[0]); ++s) {
+		t14_run(t14_sizes[s]);
+	}
+	TEST_CHECK_(d14.failed == 0, "%d yields in the ring failed", d14.failed);
+	MyExitThread();
+}
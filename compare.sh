@@ -0,0 +1,166 @@
+#!/usr/bin/env bash
+
+# Compares the benchmarks of two runners, e.g. your kernel with the
+# reference kernel, or two builds of your kernel.
+# USAGE:
+# ./compare.sh mybench refbench                # all benchmarks, 10 trials
+# ./compare.sh -n 30 mybench refbench kernel   # 30 trials of kernel_calls
+# ./compare.sh mybench.old mybench             # before and after a change
+#
+# Each trial runs every selected benchmark once with each runner, in
+# alternating order, so that drift in the machine's speed (frequency
+# scaling, other load) affects both runners alike. For each BENCH result,
+# the table shows the ratio of the first runner's time to the second's
+# (geometric mean over trials), its 95% confidence interval, and the p-value
+# of a paired t-test on the log ratios. '*' marks ratios that differ from
+# 1 at the 5% level.
+usage () {
+  echo "Usage: ./compare.sh [ -n TRIALS ] RUNNER_A RUNNER_B [ BENCHMARK ... ]"
+  exit 1
+}
+
+trials=10
+
+# Parse options
+while getopts ":n:" opt; do
+  case $opt in
+    n) trials="$OPTARG" ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+[[ $# -ge 2 && $trials -ge 2 ]] || usage
+a="$1"
+b="$2"
+shift 2
+[[ $a == */* ]] || a="./$a"
+[[ $b == */* ]] || b="./$b"
+
+for suite in "$a" "$b"; do
+  if [[ ! -x $suite ]]; then
+    echo "*** FATAL: Cannot execute $suite ***"
+    usage
+  fi
+done
+
+# The benchmark cases to run: all of them, or those matching the arguments
+names=`$a --list 2>&1 | awk '/^  / { print $1 }'`
+if [[ $# -gt 0 ]]; then
+  selected=""
+  for name in $names; do
+    for arg in "$@"; do
+      if [[ $name == *$arg* ]]; then
+        selected="$selected $name"
+        break
+      fi
+    done
+  done
+  names="$selected"
+fi
+if [[ -z $names ]]; then
+  echo "*** FATAL: No benchmarks selected ***"
+  usage
+fi
+
+# Print "RUNNER TRIAL CASE:BENCH NS" for each BENCH result of a run
+run () {
+  $1 "$3" | awk -v runner="$2" -v trial="$4" '
+    /^Test / { test = $2; sub(/(\.\.\.|:)$/, "", test) }
+    /^  bench / { name = $2; sub(/:$/, "", name); print runner, trial, test ":" name, $3 }
+    /FAILED/ { print "compare.sh: " test " failed" > "/dev/stderr" }'
+}
+
+results=`mktemp`
+trap 'rm -f "$results"' EXIT
+
+for ((trial = 1; trial <= trials; trial++)); do
+  echo -n "Trial $trial of $trials..." >&2
+  for name in $names; do
+    if ((trial % 2)); then
+      run "$a" A "$name" $trial >> "$results"
+      run "$b" B "$name" $trial >> "$results"
+    else
+      run "$b" B "$name" $trial >> "$results"
+      run "$a" A "$name" $trial >> "$results"
+    fi
+  done
+  echo -ne "\r" >&2
+done
+
+echo "A = $a, B = $b, $trials trials"
+awk '
+  # Regularized incomplete beta function I_x(a, b) (Numerical Recipes)
+  function betacf(a, b, x,    m, m2, aa, c, d, del, h) {
+    c = 1; d = 1 - (a + b) * x / (a + 1)
+    if (d * d < 1e-300) d = 1e-300
+    d = 1 / d; h = d
+    for (m = 1; m <= 200; m++) {
+      m2 = 2 * m
+      aa = m * (b - m) * x / ((a - 1 + m2) * (a + m2))
+      d = 1 + aa * d; if (d * d < 1e-300) d = 1e-300
+      c = 1 + aa / c; if (c * c < 1e-300) c = 1e-300
+      d = 1 / d; h *= d * c
+      aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + 1 + m2))
+      d = 1 + aa * d; if (d * d < 1e-300) d = 1e-300
+      c = 1 + aa / c; if (c * c < 1e-300) c = 1e-300
+      d = 1 / d; del = d * c; h *= del
+      if (del - 1 < 3e-12 && 1 - del < 3e-12) break
+    }
+    return h
+  }
+  function lgam(x,    s) {  # log gamma (Stirling series, shifted up past 7)
+    s = 0
+    while (x < 7) { s -= log(x); x++ }
+    return s + (x - 0.5) * log(x) - x + 0.918938533204673 \
+      + 1 / (12 * x) - 1 / (360 * x ^ 3) + 1 / (1260 * x ^ 5)
+  }
+  function betai(a, b, x,    bt) {
+    if (x <= 0) return 0
+    if (x >= 1) return 1
+    bt = exp(lgam(a + b) - lgam(a) - lgam(b) + a * log(x) + b * log(1 - x))
+    if (x < (a + 1) / (a + b + 2)) return bt * betacf(a, b, x) / a
+    return 1 - bt * betacf(b, a, 1 - x) / b
+  }
+  # Two-sided p-value of Student t with df degrees of freedom
+  function tp(t, df) { return betai(df / 2, 0.5, df / (df + t * t)) }
+  # Two-sided 95% critical value, by bisection
+  function tcrit(df,    lo, hi, mid) {
+    lo = 0; hi = 1000
+    while (hi - lo > 1e-6) {
+      mid = (lo + hi) / 2
+      if (tp(mid, df) > 0.05) lo = mid; else hi = mid
+    }
+    return lo
+  }
+
+  {
+    key = $3
+    if (!(key in seen)) { seen[key] = 1; keys[++nkeys] = key }
+    v[$1, key, $2] = log($4)
+  }
+
+  END {
+    printf "%-40s %11s %11s %8s %17s %8s\n", "benchmark", "A ns/op", "B ns/op", "A/B", "95% CI", "p"
+    for (k = 1; k <= nkeys; k++) {
+      key = keys[k]
+      n = 0; sa = 0; sb = 0; sd = 0; sdd = 0
+      for (i = 1; i <= '"$trials"'; i++) {
+        if (!(("A", key, i) in v) || !(("B", key, i) in v)) continue
+        d = v["A", key, i] - v["B", key, i]
+        sa += v["A", key, i]; sb += v["B", key, i]
+        sd += d; sdd += d * d; n++
+      }
+      if (n < 2) { printf "%-40s (fewer than 2 paired trials)\n", key; continue }
+      mean = sd / n
+      var = (sdd - n * mean * mean) / (n - 1)
+      se = sqrt(var > 0 ? var : 0) / sqrt(n)
+      if (se > 0) {
+        p = tp(mean / se, n - 1); half = tcrit(n - 1) * se
+      } else {
+        p = (mean == 0) ? 1 : 0; half = 0
+      }
+      printf "%-40s %11.1f %11.1f %7.3fx  [%6.3f, %6.3f] %8.4f %s\n", key,
+        exp(sa / n), exp(sb / n), exp(mean), exp(mean - half), exp(mean + half),
+        p, (p < 0.05) ? "*" : ""
+    }
+  }' "$results"
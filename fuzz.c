@@ -0,0 +1,149 @@
+/**
+ * Coverage-guided fuzzer of your kernel, built with libFuzzer.
+ *
+ * USAGE:
+ * make fuzz
+ * ./fuzz corpus/                # fuzz, keeping interesting inputs in corpus/
+ * ./fuzz crash-<hash>           # rerun a failing input
+ *
+ * Each input is a script of kernel API calls, one per byte: the low 2 bits
+ * pick the call (create, yield, sched, exit) and the rest the yield target,
+ * -1 to MAXTHREADS. mykernel4.c is compiled with edge coverage, so libFuzzer
+ * evolves scripts that reach new branches of your kernel, such as ID
+ * wraparound and a full thread table, which random scripts rarely reach.
+ *
+ * Every thread runs the script from where the previous thread left off, and
+ * after each call checks that
+ *   - CreateThread returns an ID not in use, or -1 only if all are in use;
+ *   - GetThread returns the ID of the running thread, which is active;
+ *   - YieldThread returns -1 for an invalid or inactive target, its caller's
+ *     ID for itself, and otherwise a valid ID.
+ * A failed check aborts with a message, and libFuzzer saves the input.
+ *
+ * Thread 0 never exits (its exits are skipped), so that when the script
+ * ends, the running thread can yield to it and it can return to libFuzzer.
+ * MyInitThreads is called again before each input, so it must reset all of
+ * your kernel's state.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "aux.h"
+#include "umix.h"
+#include "mykernel4.h"
+
+int LLVMFuzzerRunDriver(int *argc, char ***argv,
+		int (*cb)(const uint8_t *data, size_t size));
+
+enum { F_CREATE, F_YIELD, F_SCHED, F_EXIT };
+
+static struct {
+	const uint8_t *data;
+	size_t size, pos;
+	int active[MAXTHREADS], nactive;
+} fz;
+
+static void f_fail(const char *fmt, ...) {
+	va_list args;
+	fprintf(stderr, "\nfuzz: after call %zu of %zu: ", fz.pos, fz.size);
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+	abort();
+}
+
+static void f_thread(int _);
+
+// Run the rest of the script as thread `me`
+static void f_run(int me) {
+	int target, valid, ret;
+
+	while (fz.pos < fz.size) {
+		uint8_t b = fz.data[fz.pos++];
+		target = (b >> 2) % (MAXTHREADS + 2) - 1;
+
+		switch (b & 3) {
+		case F_CREATE:
+			ret = MyCreateThread(f_thread, 0);
+			if (ret == -1) {
+				if (fz.nactive < MAXTHREADS) {
+					f_fail("MyCreateThread() returned -1 with %d threads active",
+							fz.nactive);
+				}
+			} else if (ret < 0 || ret >= MAXTHREADS || fz.active[ret]) {
+				f_fail("MyCreateThread() returned %d, which is %s", ret,
+						ret < 0 || ret >= MAXTHREADS ? "invalid" : "in use");
+			} else {
+				fz.active[ret] = 1;
+				++fz.nactive;
+			}
+			break;
+		case F_YIELD:
+			valid = target >= 0 && target < MAXTHREADS && fz.active[target];
+			ret = MyYieldThread(target);
+			if (!valid && ret != -1) {
+				f_fail("MyYieldThread(%d) returned %d, expected -1",
+						target, ret);
+			} else if (target == me && ret != me) {
+				f_fail("MyYieldThread(%d) to itself returned %d", target, ret);
+			} else if (valid && (ret < 0 || ret >= MAXTHREADS)) {
+				f_fail("MyYieldThread(%d) returned invalid ID %d", target, ret);
+			}
+			break;
+		case F_SCHED:
+			MySchedThread();
+			break;
+		case F_EXIT:
+			if (me == 0) { break; }
+			fz.active[me] = 0;
+			--fz.nactive;
+			MyExitThread();
+			f_fail("MyExitThread() returned to T%d", me);
+			break;
+		}
+
+		if (!fz.active[me]) { f_fail("T%d runs after exiting", me); }
+		if ((ret = MyGetThread()) != me) {
+			f_fail("T%d runs, but MyGetThread() returned %d", me, ret);
+		}
+	}
+
+	// The script is over: get back to thread 0, which returns to libFuzzer
+	if (me != 0) {
+		MyYieldThread(0);
+		f_fail("T%d resumed after the script ended", me);
+	}
+}
+
+static void f_thread(int _) {
+	int me = MyGetThread();
+
+	(void) _;
+	if (me < 0 || me >= MAXTHREADS || !fz.active[me]) {
+		f_fail("new thread runs as T%d, which was not created", me);
+	}
+	f_run(me);
+}
+
+static int f_one(const uint8_t *data, size_t size) {
+	fz.data = data;
+	fz.size = size;
+	fz.pos = 0;
+	for (int i = 0; i < MAXTHREADS; ++i) { fz.active[i] = 0; }
+	fz.active[0] = 1;
+	fz.nactive = 1;
+
+	MyInitThreads();
+	if (MyGetThread() != 0) {
+		f_fail("MyGetThread() returned %d after MyInitThreads()", MyGetThread());
+	}
+	f_run(0);
+	return 0;
+}
+
+void Main(int argc, char **argv) {
+	exit(LLVMFuzzerRunDriver(&argc, &argv, f_one));
+}
@@ -0,0 +1,301 @@
+/**
+ * Golden traces, linked into the refgold and mygold runners.
+ *
+ * A test's trace is what the kernel lets the test observe, one line per
+ * event, in order: each kernel API call with the calling thread, its
+ * arguments and what it returned, and the location and outcome of each
+ * condition the test checks. After a header line:
+ *
+ *   create 0 -> 1              T0 created T1
+ *   yield 1 0 -> 0             T1 yielded to T0, and T0 yielded back
+ *   get 1
+ *   sched 1
+ *   exit 1
+ *   check all75.c:102 ok
+ *
+ * A yield is written when it returns, after the events of the threads that
+ * ran in between. A line repeated N times in a row is written once, with
+ * " *N" appended, so that checks in loops do not make huge files. Only
+ * the test's own process is traced, not processes it forks.
+ *
+ * The runners are linked with -Wl,--wrap for the kernel API functions, like
+ * the profiling runners (see apiprof.c). refgold (the reference kernel)
+ * writes the trace of each test to $GOLDEN/<test>.golden: GOLDEN is
+ * tests/golden by default, and a '/' in the test name becomes '-'. mygold
+ * (your kernel) compares its trace with that file as the test runs, and
+ * fails the test at the first line that differs, showing both. So mygold
+ * needs no run of the reference kernel. golden.sh records the golden files
+ * of all tests; those of tests whose trace depends on timing only mark them
+ * as "unstable", and are not compared.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "aux.h"
+#include "umix.h"
+#include "mykernel4.h"
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#define GOLDEN_VERSION 1
+
+#ifdef USE_REFERENCE_KERNEL
+#define API(name) name
+#define G_RECORD  1
+#else
+#define API(name) My##name
+#define G_RECORD  0
+#endif
+#define CAT2(a, b) a##b
+#define CAT(a, b)  CAT2(a, b)
+#define WRAP(name) CAT(__wrap_, API(name))
+#define REAL(name) CAT(__real_, API(name))
+
+int  REAL(CreateThread)(void (*func)(), int param);
+int  REAL(GetThread)();
+int  REAL(YieldThread)(int t);
+void REAL(SchedThread)();
+void REAL(ExitThread)();
+
+static struct {
+	int opened;
+	char path[1024];
+	int out;		// refgold: the trace being written, or -1
+	char buf[65536];	// refgold: what is not written out yet
+	int used;
+	char last[256];		// refgold: the last line, not written yet
+	long repeats;		// refgold: how many times in a row
+	char *golden;		// mygold: the golden trace
+	char *next;		// mygold: the line after the current one
+	const char *cur;	// mygold: the current line
+	int cur_len;		// mygold: its length, without the repeat count
+	long left;		// mygold: its repeats still to come
+	int skip;		// mygold: the test is unstable, or has diverged
+	long events;
+} g;
+
+static void g_end(int sig);
+
+// Read the whole golden trace, or NULL
+static char *g_read(const char *path) {
+	FILE *f = fopen(path, "rb");
+	char *buf;
+	long len;
+
+	if (f == NULL) { return NULL; }
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	rewind(f);
+	if ((buf = malloc(len + 1)) != NULL) {
+		len = fread(buf, 1, len, f);
+		buf[len] = '\0';
+	}
+	fclose(f);
+	return buf;
+}
+
+// The length of the line at p, without its newline
+static int g_linelen(const char *p) {
+	const char *end = strchr(p, '\n');
+	return end ? (int) (end - p) : (int) strlen(p);
+}
+
+// Move to the next line of the golden trace; 0 at its end
+static int g_load() {
+	int len = g_linelen(g.next);
+	const char *star = g.next + len;
+
+	if (*g.next == '\0') { return 0; }
+	g.cur = g.next;
+	g.cur_len = len;
+	g.left = 1;
+	g.next += len + (g.next[len] == '\n');
+
+	// A trailing " *N" is a repeat count
+	while (star > g.cur && star[-1] >= '0' && star[-1] <= '9') { --star; }
+	if (star < g.cur + len && star - g.cur >= 2 && star[-1] == '*' && star[-2] == ' ') {
+		g.cur_len = star - 2 - g.cur;
+		g.left = atol(star);
+	}
+	return 1;
+}
+
+// Append to refgold's trace. It is buffered here rather than by stdio,
+// whose buffer a forked process would write out again when it exits.
+static void g_write(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void g_write(const char *fmt, ...) {
+	va_list args;
+	int n;
+
+	if (g.used > (int) sizeof(g.buf) - 512) {
+		if (write(g.out, g.buf, g.used) != g.used) { perror(g.path); }
+		g.used = 0;
+	}
+	va_start(args, fmt);
+	n = vsnprintf(g.buf + g.used, sizeof(g.buf) - g.used, fmt, args);
+	va_end(args);
+	g.used += n;
+}
+
+// Write out the last line of refgold's trace
+static void g_flush() {
+	if (g.repeats == 1) {
+		g_write("%s\n", g.last);
+	} else if (g.repeats > 1) {
+		g_write("%s *%ld\n", g.last, g.repeats);
+	}
+	g.repeats = 0;
+}
+
+// The golden file of the running test. Opened at its first event.
+static void g_open() {
+	const char *dir = getenv("GOLDEN");
+	char header[256];
+	int n;
+
+	g.opened = 1;
+	n = snprintf(g.path, sizeof(g.path), "%s/", dir ? dir : "tests/golden");
+	for (const char *c = TEST_NAME(); *c && n < (int) sizeof(g.path) - 8; ++c) {
+		g.path[n++] = *c == '/' ? '-' : *c;
+	}
+	strcpy(g.path + n, ".golden");
+	snprintf(header, sizeof(header), "# golden %d %s", GOLDEN_VERSION, TEST_NAME());
+
+	if (G_RECORD) {
+		if ((g.out = open(g.path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+			perror(g.path);
+			return;
+		}
+		g_write("%s\n", header);
+		return;
+	}
+
+	g.skip = 1;
+	if ((g.golden = g_read(g.path)) == NULL) {
+		TEST_CHECK_(0, "no golden trace %s; record it with ./golden.sh", g.path);
+		return;
+	}
+	g.next = g.golden + g_linelen(g.golden);
+	if (*g.next == '\n') { ++g.next; }
+	n = g_linelen(g.golden);
+	if (strncmp(g.golden, header, strlen(header)) == 0 && n == (int) strlen(header)) {
+		g.skip = 0;
+	} else if (strncmp(g.golden, header, strlen(header)) == 0 &&
+			n == (int) strlen(header) + 9 && strncmp(g.golden + n - 9, " unstable", 9) == 0) {
+		TEST_RESULT("golden: not compared, as the trace depends on timing");
+	} else {
+		TEST_CHECK_(0, "%s is not a golden trace of this test, version %d",
+				g.path, GOLDEN_VERSION);
+		TEST_MSG("Header: %.*s", n, g.golden);
+	}
+}
+
+static void g_event(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void g_event(const char *fmt, ...) {
+	char line[256];
+	va_list args;
+	int len;
+
+	if (getpid() != TEST_PID()) { return; }
+	if (!g.opened) { g_open(); }
+	va_start(args, fmt);
+	vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+	++g.events;
+
+	if (G_RECORD) {
+		if (g.out == -1) { return; }
+		if (g.repeats > 0 && strcmp(line, g.last) == 0) {
+			++g.repeats;
+		} else {
+			g_flush();
+			strcpy(g.last, line);
+			g.repeats = 1;
+		}
+		return;
+	}
+	if (g.skip) { return; }
+	if (g.left == 0 && !g_load()) {
+		g.skip = 1;
+		TEST_CHECK_(0, "diverged from the reference at event %ld (%s)", g.events, g.path);
+		TEST_MSG("Expected: (the end of the test)");
+		TEST_MSG("Got:      %s", line);
+		return;
+	}
+	len = strlen(line);
+	if (len == g.cur_len && strncmp(g.cur, line, len) == 0) {
+		--g.left;
+		return;
+	}
+	g.skip = 1;	// report only the first divergence
+	TEST_CHECK_(0, "diverged from the reference at event %ld (%s)", g.events, g.path);
+	TEST_MSG("Expected: %.*s", g.cur_len, g.cur);
+	TEST_MSG("Got:      %s", line);
+}
+
+// The end hook of the test (see acutest.h): write out refgold's trace, or
+// check that the test did not end before the reference's did
+static void g_end(int sig) {
+	if (!g.opened) { return; }
+	if (G_RECORD && g.out != -1) {
+		g_flush();
+		if (write(g.out, g.buf, g.used) != g.used || close(g.out) != 0) {
+			perror(g.path);
+		}
+	} else if (!G_RECORD && !g.skip && sig == 0 && (g.left > 0 || g_load())) {
+		g.skip = 1;
+		TEST_CHECK_(0, "ended after %ld events, before the reference (%s)",
+				g.events, g.path);
+		TEST_MSG("Expected: %.*s", g.cur_len, g.cur);
+	}
+	free(g.golden);
+	memset(&g, 0, sizeof(g));	// the next test (--no-exec) starts afresh
+}
+
+static void g_check(const char *file, int line, int cond) {
+	const char *base;
+
+	if (file == NULL || TEST_NAME() == NULL || (g.opened && g.skip)) { return; }
+	base = strrchr(file, '/');
+	g_event("check %s:%d %s", base ? base + 1 : file, line, cond ? "ok" : "failed");
+}
+
+__attribute__((constructor)) static void g_init() {
+	test_check_hook__ = g_check;
+	test_end_hook__ = g_end;
+	test_thread_id__ = REAL(GetThread);	// not an event of the test
+	test_perf_off__ = "kernel calls are traced";
+}
+
+int WRAP(CreateThread)(void (*func)(), int param) {
+	int t = REAL(CreateThread)(func, param);
+	g_event("create %d -> %d", REAL(GetThread)(), t);
+	return t;
+}
+
+int WRAP(GetThread)() {
+	int t = REAL(GetThread)();
+	g_event("get %d", t);
+	return t;
+}
+
+int WRAP(YieldThread)(int t) {
+	int me = REAL(GetThread)();
+	int from = REAL(YieldThread)(t);
+	g_event("yield %d %d -> %d", me, t, from);
+	return from;
+}
+
+void WRAP(SchedThread)() {
+	g_event("sched %d", REAL(GetThread)());
+	REAL(SchedThread)();
+}
+
+void WRAP(ExitThread)() {
+	g_event("exit %d", REAL(GetThread)());
+	REAL(ExitThread)();
+}
@@ -0,0 +1,61 @@
+#!/usr/bin/env bash
+
+# Records the golden traces of the tests with the reference kernel, which
+# the mygold runner compares your kernel with (see golden.c).
+# USAGE:
+# ./golden.sh                 # record all tests
+# ./golden.sh all75 churn     # record the tests matching the arguments
+#
+# The traces go to tests/golden, one file per test. Each test is recorded
+# twice: if the two traces differ, the test depends on timing, and its file
+# only marks it as unstable, so that mygold does not compare it. Commit the
+# files, and record them again when a test changes.
+usage () {
+  echo "Usage: ./golden.sh [ TEST ... ]"
+  exit 1
+}
+
+[[ $1 == -* ]] && usage
+if [[ ! -x ./refgold ]]; then
+  echo "*** FATAL: Cannot execute ./refgold; run 'make gold' ***"
+  usage
+fi
+
+# The tests to record: all of them, or those matching the arguments
+names=`./refgold --list 2>&1 | awk '/^  / { print $1 }'`
+if [[ $# -gt 0 ]]; then
+  selected=""
+  for name in $names; do
+    for arg in "$@"; do
+      if [[ $name == *$arg* ]]; then
+        selected="$selected $name"
+        break
+      fi
+    done
+  done
+  names="$selected"
+fi
+if [[ -z $names ]]; then
+  echo "*** FATAL: No tests selected ***"
+  usage
+fi
+
+first=`mktemp -d`
+second=`mktemp -d`
+trap 'rm -rf "$first" "$second"' EXIT
+mkdir -p tests/golden
+
+for name in $names; do
+  file=`echo "$name" | tr / -`.golden
+  GOLDEN=$first ./refgold "$name" > /dev/null 2>&1
+  GOLDEN=$second ./refgold "$name" > /dev/null 2>&1
+  if [[ ! -f $first/$file ]]; then
+    echo "$name: no kernel calls or checks, not recorded"
+  elif cmp -s "$first/$file" "$second/$file"; then
+    cp "$first/$file" "tests/golden/$file"
+    echo "$name: `wc -l < "$first/$file"` lines"
+  else
+    head -n 1 "$first/$file" | sed 's/$/ unstable/' > "tests/golden/$file"
+    echo "$name: unstable"
+  fi
+done
@@ -1,7 +1,7 @@
 #!/bin/bash
 
-cp -i Makefile acutest.h assimilate.sh runall.sh ~/pa4
-rm -rf ~/pa4/tests
-cp -r tests ~/pa4
+cp -i Makefile acutest.h sync.h timer.h trace.h apiprof.c kernels.c trace.c golden.c shrink.c fuzz.c assimilate.sh runall.sh compare.sh golden.sh ~/pa4
+rm -rf ~/pa4/tests ~/pa4/benchmarks
+cp -r tests benchmarks ~/pa4
 cd ~/pa4
 ./assimilate.sh
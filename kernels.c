@@ -0,0 +1,96 @@
+/**
+ * Kernel loader, linked into the kerntest and kernbench runners.
+ *
+ * The runners are built from the same tests and benchmarks as mytest and
+ * mybench, but the kernel API functions they call are the trampolines
+ * below, which pass each call on to a kernel chosen at run time. Each
+ * --kernel=SO option dlopen()s a shared object that defines the six My*
+ * functions, such as mykernel4.so (`make mykernel4.so`), a build of it with
+ * other options, or a variant of mykernel4.c. --kernel=ref is the reference
+ * kernel, which is linked into the runner.
+ *
+ * All kernels are loaded up front by the runner, and each test's child
+ * process switches to its kernel before the test starts, so every run
+ * starts with a kernel that has not run before, as in mytest. A kernel
+ * resolves the UMIX and C library functions it calls against the runner,
+ * which is linked with -rdynamic for that.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+#include "aux.h"
+#include "umix.h"
+#include "mykernel4.h"
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+struct kernel {
+	void (*init)();
+	int  (*create)(void (*func)(), int param);
+	int  (*get)();
+	int  (*yield)(int t);
+	void (*sched)();
+	void (*exit)();
+};
+
+static struct kernel k_loaded[TEST_KERNELS_MAX];
+static struct kernel k_cur;
+
+// Load the kernel named by spec as kernel k: "ref" or the path of a shared
+// object. Returns -1 with a message on stderr if it cannot be loaded.
+int test_kernel_load__(int k, const char *spec) {
+	struct kernel *kern = &k_loaded[k];
+	void *h;
+
+	if (strcmp(spec, "ref") == 0) {
+		kern->init = InitThreads;
+		kern->create = CreateThread;
+		kern->get = GetThread;
+		kern->yield = YieldThread;
+		kern->sched = SchedThread;
+		kern->exit = ExitThread;
+		return 0;
+	}
+
+	// A path without a slash would be looked up in the library path
+	if (strchr(spec, '/') == NULL) {
+		char path[4096];
+
+		snprintf(path, sizeof(path), "./%s", spec);
+		h = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	} else {
+		h = dlopen(spec, RTLD_NOW | RTLD_LOCAL);
+	}
+	if (h == NULL) {
+		fprintf(stderr, "Cannot load kernel %s: %s\n", spec, dlerror());
+		return -1;
+	}
+
+#define K_SYM(field, name)                                                    \
+	if ((*(void **) &kern->field = dlsym(h, #name)) == NULL) {                \
+		fprintf(stderr, "Kernel %s does not define %s\n", spec, #name);       \
+		dlclose(h);                                                           \
+		return -1;                                                            \
+	}
+	K_SYM(init, MyInitThreads);
+	K_SYM(create, MyCreateThread);
+	K_SYM(get, MyGetThread);
+	K_SYM(yield, MyYieldThread);
+	K_SYM(sched, MySchedThread);
+	K_SYM(exit, MyExitThread);
+#undef K_SYM
+	return 0;
+}
+
+// Make kernel k the one that the trampolines call
+void test_kernel_use__(int k) {
+	k_cur = k_loaded[k];
+}
+
+void MyInitThreads() { k_cur.init(); }
+int  MyCreateThread(void (*func)(), int param) { return k_cur.create(func, param); }
+int  MyGetThread() { return k_cur.get(); }
+int  MyYieldThread(int t) { return k_cur.yield(t); }
+void MySchedThread() { k_cur.sched(); }
+void MyExitThread() { k_cur.exit(); }
@@ -6,15 +6,30 @@
 # ./runall.sh    mytest   # Test using your kernel.
 # ./runall.sh -v reftest  # Test using reference kernel; print each assertion.
 # ./runall.sh -v mytest   # Test using your kernel; print each assertion.
+# ./runall.sh -f mytest   # Rerun every test, even those cached.
+#
+# A test that passed is not run again while its inputs are unchanged: its
+# object file, mykernel4.o, acutest.h, the runner executable, the options, the
+# environment variables tests read (EXPLORE_SLOW, GOLDEN, TRACE) and, for the
+# golden runners, its golden trace. Its output from the last run, with its
+# timings, is printed instead. The results are cached in .runall/RUNNER.
+# Tests that failed, or whose inputs changed, always run, and so do
+# benchmarks, whose results are only worth seeing when just measured. The
+# objects in tests/ and benchmarks/ are those of the last runner built, so
+# building another runner makes its tests run again.
 usage () {
-  echo "Usage: ./runall.sh [ -v ] [ reftest | mytest ]"
+  echo "Usage: ./runall.sh [ -v ] [ -f ] [ reftest | mytest ]"
   exit 1
 }
 
+force=0
+store=1
+
 # Parse options
-while getopts ":v" opt; do
+while getopts ":vf" opt; do
   case $opt in
     v) args="$args -v" ;;
+    f) force=1 ;;
     *) usage ;;
   esac
 done
@@ -26,6 +41,50 @@ if [[ ! -x $suite ]]; then
   usage
 fi
 
-$suite --list 2>&1 | awk '/^  / { print $1 }' | while read name; do
-  eval "$suite $args $name"
+runner=`basename "$suite"`
+dir=`dirname "$suite"`
+case $runner in
+  *bench) objdir="$dir/benchmarks"; force=1; store=0 ;;
+  *)      objdir="$dir/tests" ;;
+esac
+cache="$dir/.runall/$runner"
+[[ $store == 1 ]] && mkdir -p "$cache"
+[[ -t 1 ]] && color="--color=always"
+out=`mktemp`
+trap 'rm -f "$out"' EXIT
+
+# The hash of what all tests depend on
+common=`{ echo "$runner $args"; env | grep -E '^(EXPLORE_SLOW|GOLDEN|TRACE)=' | sort;
+  cat "$suite" "$dir/mykernel4.o" "$dir/acutest.h" 2> /dev/null; } | sha1sum | cut -c1-40`
+
+cached=0
+total=0
+for name in `$suite --list 2>&1 | awk '/^  / { print $1 }'`; do
+  total=$((total + 1))
+  obj="$objdir/${name%%/*}.o"
+  file="$cache/${name//\//-}"
+  key=""
+  golden=""
+  [[ $runner == *gold ]] && golden="${GOLDEN:-tests/golden}/${name//\//-}.golden"
+  if [[ -f $obj ]]; then
+    key=`{ echo "$common $name"; cat "$obj" $golden 2> /dev/null; } | sha1sum | cut -c1-40`
+  fi
+
+  if [[ $force == 0 && -n $key && -f $file && `head -n 1 "$file"` == $key ]]; then
+    tail -n +2 "$file"
+    cached=$((cached + 1))
+    continue
+  fi
+
+  # Runners may exit with 0 although a test failed: check its verdict too
+  eval "$suite $color $args $name" | tee "$out"
+  if [[ ${PIPESTATUS[0]} == 0 && $store == 1 && -n $key ]] && ! grep -q "FAILED" "$out"; then
+    { echo "$key"; cat "$out"; } > "$file"
+  else
+    rm -f "$file"
+  fi
 done
+
+if [[ $cached -gt 0 ]]; then
+  echo "$cached of $total tests unchanged since they passed, not run again (-f runs them)"
+fi
@@ -0,0 +1,327 @@
+/**
+ * Schedule shrinker: reduces a failing all75-style command table to a
+ * minimal table that still fails the same way against your kernel.
+ *
+ * USAGE:
+ * ./shrink tests/all75.c        # shrink the table of all75
+ * ./shrink my_table.c           # any file with t13_order_cmd rows
+ *
+ * Rows are read in the t13_order_cmd format ("[ 7] = {4, T13_YIELD | 5},"
+ * or "{4, T13_YIELD | 5},"), one per line; other lines are ignored. Each
+ * candidate table is run in forked children, and interpreted as in all75,
+ * against both your kernel and the reference kernel. A candidate is kept if
+ * it passes with the reference kernel (so it is still a valid scenario) and
+ * fails with yours "the same way": its first failed check is of the same
+ * kind (thread order, create, create error, crash or hang) and in the same
+ * row of the original table. Candidates are chosen by delta debugging
+ * (ddmin), so the result is 1-minimal: removing any single row from it makes
+ * the failure go away (or change).
+ */
+
+#include <ctype.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "aux.h"
+#include "umix.h"
+#include "mykernel4.h"
+#include "tests/all75.h"
+
+#define S_MAX_ROWS 4096
+#define S_TIMEOUT  2	// seconds before a candidate is considered hung
+
+enum { S_PASS, S_ORDER, S_CREATE, S_CREATE_ERR, S_CRASH, S_HANG };
+static const char *s_kinds[] = {
+	"pass", "thread order", "create", "create error", "crash", "hang",
+};
+
+// A failure: its kind and the row of the original table it happened in
+struct s_result {
+	int kind, row;
+};
+
+// The kernels a candidate is run against
+static const struct s_kernel {
+	void (*init)();
+	int (*create)(void (*func)(), int param);
+	int (*get)();
+	int (*yield)(int t);
+	void (*sched)();
+	void (*exit)();
+} s_mine = {
+	MyInitThreads, MyCreateThread, MyGetThread,
+	MyYieldThread, MySchedThread, MyExitThread,
+}, s_ref = {
+	InitThreads, CreateThread, GetThread,
+	YieldThread, SchedThread, ExitThread,
+};
+
+static struct {
+	int order[S_MAX_ROWS], cmd[S_MAX_ROWS];	// the original table
+	int rows;
+	char *line[S_MAX_ROWS];	// source text of each row, for messages
+
+	// The candidate being run, as indices into the original table
+	const struct s_kernel *k;
+	const int *cand;
+	int len, round;
+
+	// Written by the child, read by the parent
+	struct {
+		int round;
+		struct s_result result;
+	} *shared;
+
+	int runs;
+} sh;
+
+// Record the first failed check
+static void s_fail(int kind, int row) {
+	if (sh.shared->result.kind == S_PASS) {
+		sh.shared->result.kind = kind;
+		sh.shared->result.row = row;
+	}
+}
+
+// Interpret the candidate as all75's t13_func does
+static void s_func(int _) {
+	int row, cmd, created;
+
+	while (sh.round < sh.len) {
+		row = sh.cand[sh.round];
+		sh.shared->round = row;
+		cmd = sh.cmd[row];
+		++sh.round;
+		if (sh.order[row] != sh.k->get()) { s_fail(S_ORDER, row); }
+
+		if (cmd & T13_CREATE) {
+			created = sh.k->create(s_func, _);
+			if (cmd & T13_CREATE_ERR) {
+				if (created != -1) { s_fail(S_CREATE_ERR, row); }
+			} else if (created == -1) {
+				s_fail(S_CREATE, row);
+			}
+		}
+		if (cmd & T13_EXIT) { sh.k->exit(); }
+		if (cmd & T13_SCHED) {
+			sh.k->sched();
+			continue;
+		}
+		if (cmd & T13_YIELD) { sh.k->yield(T13_TARGET(cmd)); }
+	}
+	sh.k->exit();
+}
+
+// Run a candidate in a child process and return how it failed
+static struct s_result s_run(const struct s_kernel *k, const int *cand, int len) {
+	struct s_result result = { S_PASS, -1 };
+	int status;
+	pid_t pid;
+
+	++sh.runs;
+	sh.k = k;
+	sh.cand = cand;
+	sh.len = len;
+	sh.round = 0;
+	sh.shared->round = -1;
+	sh.shared->result = result;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0) {
+		freopen("/dev/null", "w", stdout);	// kernel output is noise here
+		alarm(S_TIMEOUT);
+		k->init();
+		s_func(0);
+		exit(0);
+	}
+	if (pid == -1 || waitpid(pid, &status, 0) != pid) {
+		perror("shrink: cannot run candidate");
+		exit(2);
+	}
+
+	result = sh.shared->result;
+	if (result.kind == S_PASS && WIFSIGNALED(status)) {
+		result.kind = (WTERMSIG(status) == SIGALRM) ? S_HANG : S_CRASH;
+		result.row = sh.shared->round;
+	}
+	return result;
+}
+
+// Is the candidate valid, and does it fail like `target` with your kernel?
+static int s_interesting(const int *cand, int len, struct s_result target) {
+	struct s_result r = s_run(&s_mine, cand, len);
+	return r.kind == target.kind && r.row == target.row
+		&& s_run(&s_ref, cand, len).kind == S_PASS;
+}
+
+// ddmin: shrink cand (of *len rows) in place while it fails like `target`
+static void s_ddmin(int *cand, int *len, struct s_result target) {
+	static int test[S_MAX_ROWS];
+	int n = 2;
+
+	while (*len >= 2) {
+		int chunk = (*len + n - 1) / n, reduced = 0;
+
+		// Try each chunk on its own, then each complement
+		for (int pass = 0; pass < 2 && !reduced; ++pass) {
+			for (int start = 0; start < *len && !reduced; start += chunk) {
+				int end = start + chunk < *len ? start + chunk : *len;
+				int tlen = 0;
+				for (int i = 0; i < *len; ++i) {
+					if ((i >= start && i < end) == (pass == 0)) {
+						test[tlen++] = cand[i];
+					}
+				}
+				if (tlen == 0 || tlen == *len) { continue; }
+				if (s_interesting(test, tlen, target)) {
+					memcpy(cand, test, tlen * sizeof(int));
+					*len = tlen;
+					n = (pass == 0) ? 2 : (n - 1 > 2 ? n - 1 : 2);
+					reduced = 1;
+				}
+			}
+		}
+		if (reduced) { continue; }
+		if (n >= *len) { break; }
+		n = (2 * n < *len) ? 2 * n : *len;
+	}
+}
+
+static int s_parse_cmd(char *p, int *cmd) {
+	static const struct { const char *name; int flag; } flags[] = {
+		{ "T13_CREATE_ERR", T13_CREATE_ERR }, { "T13_CREATE", T13_CREATE },
+		{ "T13_EXIT", T13_EXIT }, { "T13_SCHED", T13_SCHED },
+		{ "T13_YIELD_ERR", T13_YIELD_ERR }, { "T13_YIELD", T13_YIELD },
+	};
+	char *tok;
+
+	*cmd = 0;
+	for (tok = strtok(p, "|"); tok != NULL; tok = strtok(NULL, "|")) {
+		unsigned i;
+		while (isspace((unsigned char) *tok)) { ++tok; }
+		for (i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i) {
+			size_t n = strlen(flags[i].name);
+			if (strncmp(tok, flags[i].name, n) == 0
+					&& !isalnum((unsigned char) tok[n]) && tok[n] != '_') {
+				*cmd |= flags[i].flag;
+				break;
+			}
+		}
+		if (i == sizeof(flags) / sizeof(flags[0])) {
+			if (!isdigit((unsigned char) *tok)) { return 0; }
+			*cmd |= atoi(tok);
+		}
+	}
+	return 1;
+}
+
+// Read the rows of a t13_order_cmd table
+static void s_read(const char *path) {
+	char buf[512], *p, *end;
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL) {
+		perror(path);
+		exit(2);
+	}
+	while (fgets(buf, sizeof(buf), f) != NULL) {
+		p = buf;
+		while (isspace((unsigned char) *p)) { ++p; }
+		if (*p == '[') {	// designated initializer: [ n] = {...}
+			p = strchr(p, '{');
+			if (p == NULL) { continue; }
+		}
+		if (*p != '{' || !isdigit((unsigned char) p[1])) { continue; }
+		end = strchr(p, '}');
+		if (end == NULL || sh.rows == S_MAX_ROWS) { continue; }
+
+		sh.line[sh.rows] = strdup(p);
+		*end = '\0';
+		sh.order[sh.rows] = (int) strtol(p + 1, &p, 10);
+		while (isspace((unsigned char) *p)) { ++p; }
+		if (*p != ',' || !s_parse_cmd(p + 1, &sh.cmd[sh.rows])) {
+			fprintf(stderr, "shrink: cannot parse row: %s", sh.line[sh.rows]);
+			exit(2);
+		}
+		++sh.rows;
+	}
+	fclose(f);
+}
+
+static void s_print_row(int i, int row) {
+	static const struct { int flag; const char *name; } flags[] = {
+		{ T13_CREATE, "T13_CREATE" }, { T13_CREATE_ERR, "T13_CREATE_ERR" },
+		{ T13_EXIT, "T13_EXIT" }, { T13_SCHED, "T13_SCHED" },
+		{ T13_YIELD, "T13_YIELD" }, { T13_YIELD_ERR, "T13_YIELD_ERR" },
+	};
+	int cmd = sh.cmd[row], first = 1;
+
+	printf("\t[%2d] = {%d, ", i, sh.order[row]);
+	for (unsigned f = 0; f < sizeof(flags) / sizeof(flags[0]); ++f) {
+		if (cmd & flags[f].flag) {
+			printf("%s%s", first ? "" : " | ", flags[f].name);
+			first = 0;
+		}
+	}
+	if (cmd & T13_YIELD) { printf(" | %d", T13_TARGET(cmd)); }
+	printf("},  // was row %d\n", row);
+}
+
+void Main(int argc, char **argv) {
+	static int cand[S_MAX_ROWS];
+	struct s_result target;
+	struct timespec start, end;
+	int len;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s TABLE_FILE\n", argv[0]);
+		exit(2);
+	}
+	s_read(argv[1]);
+	if (sh.rows == 0) {
+		fprintf(stderr, "shrink: no t13_order_cmd rows in %s\n", argv[1]);
+		exit(2);
+	}
+	sh.shared = mmap(NULL, sizeof(*sh.shared), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sh.shared == MAP_FAILED) {
+		perror("shrink: mmap");
+		exit(2);
+	}
+
+	len = sh.rows;
+	for (int i = 0; i < len; ++i) { cand[i] = i; }
+	target = s_run(&s_ref, cand, len);
+	if (target.kind != S_PASS) {
+		printf("The table (%d rows) fails with the reference kernel: %s check "
+				"in row %d:\n    %s", len, s_kinds[target.kind], target.row,
+				sh.line[target.row]);
+		exit(1);
+	}
+	target = s_run(&s_mine, cand, len);
+	if (target.kind == S_PASS) {
+		printf("The table (%d rows) passes; nothing to shrink.\n", len);
+		exit(0);
+	}
+	printf("The table (%d rows) fails: %s check in row %d:\n    %s",
+			len, s_kinds[target.kind], target.row, sh.line[target.row]);
+
+	s_ddmin(cand, &len, target);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("Shrunk to %d rows in %d runs (%.2f s):\n\n", len, sh.runs,
+			(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9);
+	printf("#define T13_ROUNDS %d\n\n", len);
+	printf("static const int t13_order_cmd[T13_ROUNDS][2] = {\n");
+	for (int i = 0; i < len; ++i) { s_print_row(i, cand[i]); }
+	printf("};\n");
+	exit(0);
+}
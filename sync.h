@@ -0,0 +1,296 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+/**
+ * Cooperative synchronization on top of the thread kernel: mutexes,
+ * condition variables, counting semaphores and bounded channels.
+ *
+ * Waiting threads are queued in FIFO order, and a release hands the
+ * resource directly to the first waiter: an unlock makes it the owner of
+ * the mutex, a post gives it the unit, and a send gives it the value. So a
+ * woken thread never has to compete again for what it waited for, and no
+ * other thread can take it first. The releaser then yields to it, so that
+ * it runs next rather than after every thread ahead of it in the kernel's
+ * ready queue.
+ *
+ * The kernel has no blocked state, so a waiting thread is still picked by
+ * MySchedThread(). It passes the CPU on at once to the thread most likely
+ * to release it: the owner of the mutex it waits for (or that the
+ * condition's mutex belongs to), the last thread that posted to the
+ * semaphore, or the last one that received from (sent to) the channel it
+ * waits to send to (receive from). Every other time, and when there is no
+ * such thread, it goes through MySchedThread() instead, so that waiters
+ * whose hints point at each other cannot keep the CPU between them.
+ *
+ * Everything is in this header, since the tests build it against both
+ * kernels: include it after mykernel4.h (in tests, after tests.h). Waiters
+ * live on their own thread's stack, so there is no global state, and a
+ * zero-filled object is not valid; call the Init function first. Functions
+ * return 0, or -1 on error, like the kernel API.
+ *
+ *   Mutex m;                   MutexInit(&m);
+ *   MutexLock(&m);             ...             MutexUnlock(&m);
+ *   while (!ready) { CondWait(&c, &m); }       // CondSignal(&c) elsewhere
+ *   ChanSend(&ch, p);          ChanRecv(&ch, &p);
+ */
+
+#include <stddef.h>
+
+#ifndef CHAN_MAX
+#define CHAN_MAX 64		// maximum capacity of a channel
+#endif
+
+// The kernel calls that switch threads, which a benchmark can count
+#ifndef SYNC_YIELD
+#define SYNC_YIELD(t) MyYieldThread(t)
+#endif
+#ifndef SYNC_SCHED
+#define SYNC_SCHED()  MySchedThread()
+#endif
+
+// A thread waiting in a queue. It is on the waiting thread's stack.
+struct SyncWaiter {
+	int tid;
+	int woken;
+	int status;		// 0, or -1 if woken by ChanClose()
+	void *value;		// channel value, handed over by the waker
+	struct SyncWaiter *next;
+};
+
+typedef struct {
+	struct SyncWaiter *head, *tail;
+} SyncQueue;
+
+typedef struct {
+	int owner;		// -1 if unlocked
+	SyncQueue waiters;
+} Mutex;
+
+typedef struct {
+	SyncQueue waiters;
+} Cond;
+
+typedef struct {
+	int count;
+	int poster;		// last thread that posted, or -1
+	SyncQueue waiters;
+} Sem;
+
+typedef struct {
+	void *buf[CHAN_MAX];
+	int cap, head, len, closed;
+	int sender, receiver;	// last threads that sent and received, or -1
+	SyncQueue senders;	// waiting while the buffer is full
+	SyncQueue receivers;	// waiting while the buffer is empty
+} Chan;
+
+/* Queue w for the running thread at the end of q, and return once a waker
+ * has dequeued it, with the status the waker set. While waiting, pass the
+ * CPU to thread *hint, if there is one, and through MySchedThread() in
+ * turns. */
+static inline int SyncWait(SyncQueue *q, struct SyncWaiter *w, const int *hint) {
+	int hinted = 0;
+
+	w->tid = MyGetThread();
+	w->woken = 0;
+	w->status = 0;
+	w->next = NULL;
+	if (q->tail) { q->tail->next = w; } else { q->head = w; }
+	q->tail = w;
+
+	while (!w->woken) {
+		int t = hint && !hinted ? *hint : -1;
+		if (t < 0 || t == w->tid || SYNC_YIELD(t) == -1) {
+			SYNC_SCHED();
+			hinted = 0;
+		} else {
+			hinted = 1;
+		}
+	}
+	return w->status;
+}
+
+// Dequeue the first waiter of q, if any, and mark it woken with status
+static inline struct SyncWaiter *SyncWake(SyncQueue *q, int status) {
+	struct SyncWaiter *w = q->head;
+
+	if (w) {
+		q->head = w->next;
+		if (!q->head) { q->tail = NULL; }
+		w->status = status;
+		w->woken = 1;
+	}
+	return w;
+}
+
+// Run w, if a release has just woken it, so that it does not wait for its
+// turn in the ready queue behind threads that would only pass the CPU on
+static inline void SyncHandOff(struct SyncWaiter *w) {
+	if (w) { SYNC_YIELD(w->tid); }
+}
+
+static inline void SyncQueueInit(SyncQueue *q) {
+	q->head = q->tail = NULL;
+}
+
+/* Mutex */
+
+static inline void MutexInit(Mutex *m) {
+	m->owner = -1;
+	SyncQueueInit(&m->waiters);
+}
+
+// Returns -1 if the mutex is locked
+static inline int MutexTryLock(Mutex *m) {
+	if (m->owner != -1) { return -1; }
+	m->owner = MyGetThread();
+	return 0;
+}
+
+// Returns -1 if the running thread already holds the mutex
+static inline int MutexLock(Mutex *m) {
+	struct SyncWaiter w;
+
+	if (m->owner == MyGetThread()) { return -1; }
+	if (MutexTryLock(m) == 0) { return 0; }
+	SyncWait(&m->waiters, &w, &m->owner);	// the unlocker made us the owner
+	return 0;
+}
+
+// Hand m to its first waiter, if any, without switching to it
+static inline struct SyncWaiter *SyncMutexRelease(Mutex *m) {
+	struct SyncWaiter *w = SyncWake(&m->waiters, 0);
+
+	m->owner = w ? w->tid : -1;
+	return w;
+}
+
+// Returns -1 if the running thread does not hold the mutex
+static inline int MutexUnlock(Mutex *m) {
+	if (m->owner != MyGetThread()) { return -1; }
+	SyncHandOff(SyncMutexRelease(m));
+	return 0;
+}
+
+/* Condition variable */
+
+static inline void CondInit(Cond *c) {
+	SyncQueueInit(&c->waiters);
+}
+
+// Returns -1 if the running thread does not hold m
+static inline int CondWait(Cond *c, Mutex *m) {
+	struct SyncWaiter w;
+
+	// No switch happens between the unlock and queueing, so no signal is lost
+	if (m->owner != MyGetThread()) { return -1; }
+	SyncMutexRelease(m);
+	SyncWait(&c->waiters, &w, &m->owner);
+	return MutexLock(m);
+}
+
+static inline void CondSignal(Cond *c) {
+	SyncWake(&c->waiters, 0);
+}
+
+static inline void CondBroadcast(Cond *c) {
+	while (SyncWake(&c->waiters, 0)) { }
+}
+
+/* Counting semaphore */
+
+// Returns -1 if count is negative
+static inline int SemInit(Sem *s, int count) {
+	if (count < 0) { return -1; }
+	s->count = count;
+	s->poster = -1;
+	SyncQueueInit(&s->waiters);
+	return 0;
+}
+
+static inline void SemWait(Sem *s) {
+	struct SyncWaiter w;
+
+	if (s->count > 0) {
+		--s->count;
+		return;
+	}
+	SyncWait(&s->waiters, &w, &s->poster);	// the poster gave us its unit
+}
+
+static inline void SemPost(Sem *s) {
+	struct SyncWaiter *w;
+
+	s->poster = MyGetThread();
+	if ((w = SyncWake(&s->waiters, 0))) {
+		SyncHandOff(w);
+	} else {
+		++s->count;
+	}
+}
+
+/* Bounded channel of pointers */
+
+// Returns -1 unless 1 <= cap <= CHAN_MAX
+static inline int ChanInit(Chan *c, int cap) {
+	if (cap < 1 || cap > CHAN_MAX) { return -1; }
+	c->cap = cap;
+	c->head = c->len = c->closed = 0;
+	c->sender = c->receiver = -1;
+	SyncQueueInit(&c->senders);
+	SyncQueueInit(&c->receivers);
+	return 0;
+}
+
+// Returns -1 if the channel is or gets closed before v is delivered
+static inline int ChanSend(Chan *c, void *v) {
+	struct SyncWaiter *r, w;
+
+	if (c->closed) { return -1; }
+	c->sender = MyGetThread();
+	if ((r = SyncWake(&c->receivers, 0))) {
+		r->value = v;
+		SyncHandOff(r);
+		return 0;
+	}
+	if (c->len < c->cap) {
+		c->buf[(c->head + c->len++) % c->cap] = v;
+		return 0;
+	}
+	w.value = v;
+	return SyncWait(&c->senders, &w, &c->receiver);	// a receiver took our value
+}
+
+// Returns -1 if the channel is closed and empty
+static inline int ChanRecv(Chan *c, void **v) {
+	struct SyncWaiter *s, w;
+
+	c->receiver = MyGetThread();
+	if (c->len > 0) {
+		*v = c->buf[c->head];
+		c->head = (c->head + 1) % c->cap;
+		--c->len;
+		// Move the first waiting sender's value into the freed slot
+		if ((s = SyncWake(&c->senders, 0))) {
+			c->buf[(c->head + c->len++) % c->cap] = s->value;
+			SyncHandOff(s);
+		}
+		return 0;
+	}
+	if (c->closed) { return -1; }
+	if (SyncWait(&c->receivers, &w, &c->sender) == -1) { return -1; }
+	*v = w.value;
+	return 0;
+}
+
+// Wake all waiters with an error. Values already sent can still be received.
+// Returns -1 if the channel is already closed.
+static inline int ChanClose(Chan *c) {
+	if (c->closed) { return -1; }
+	c->closed = 1;
+	while (SyncWake(&c->receivers, -1)) { }
+	while (SyncWake(&c->senders, -1)) { }
+	return 0;
+}
+
+#endif
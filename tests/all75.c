@@ -1,4 +1,5 @@
 #include "tests.h"
+#include "all75.h"
 
 /**
  * Tests all functionality of the kernel, including a number of edge cases.
@@ -7,16 +8,10 @@
 #define T13_ROUNDS 75
 #define T13_ORDER() (t13_order_cmd[d13.round][0])
 #define T13_CMD()   (t13_order_cmd[d13.round][1])
-#define T13_CREATE     (0x100 << 1)
-#define T13_CREATE_ERR (0x100 << 2)
-#define T13_EXIT       (0x100 << 3)
-#define T13_SCHED      (0x100 << 4)
-#define T13_YIELD      (0x100 << 5)
-#define T13_YIELD_ERR  (0x100 << 6)
-#define T13_TARGET(cmd) ((cmd) & 0xff)
 
 // Array of [thread id, command].
-// Commands use the flags above to signal behavior, and are read by t13_func.
+// Commands use the flags in all75.h to signal behavior, and are read by
+// t13_func. (shrink reads tables in this format, too.)
 static const int t13_order_cmd[T13_ROUNDS][2] = {
 	[ 0] = {0, T13_CREATE | T13_YIELD | 1},  // Yield to new thread
 	[ 1] = {1, T13_CREATE | T13_SCHED},  // Yield to old before new
@@ -0,0 +1,14 @@
+#ifndef ALL75_H
+#define ALL75_H
+
+// Commands of all75's command table (t13_order_cmd). A command is an OR of
+// these flags; T13_YIELD also carries the yield target in its low byte.
+#define T13_CREATE     (0x100 << 1)
+#define T13_CREATE_ERR (0x100 << 2)
+#define T13_EXIT       (0x100 << 3)
+#define T13_SCHED      (0x100 << 4)
+#define T13_YIELD      (0x100 << 5)
+#define T13_YIELD_ERR  (0x100 << 6)
+#define T13_TARGET(cmd) ((cmd) & 0xff)
+
+#endif
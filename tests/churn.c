@@ -0,0 +1,44 @@
+#include "tests.h"
+
+/**
+ * Stress test under thread churn with k active threads at a time, for each k
+ * in [1, MAXTHREADS - 1]. T0 creates T1 to T(k - 1); then for 1000 rounds,
+ * each running thread creates its successor and exits.
+ *
+ * Threads are numbered in order of creation (T0 is thread 0), and thread n
+ * creates thread n + k. Since IDs are assigned in increasing order and the
+ * only active threads are the k - 1 most recently created, thread n must
+ * have ID n % MAXTHREADS. (k = 1, 5 and 9 were the old churn1, churn5 and
+ * churn9 tests.)
+ */
+
+#define T6_ROUNDS 1000
+
+TEST_PARAMS(churn, "k", 1, MAXTHREADS - 1);
+
+static struct {
+	int k;
+} d6;
+
+static void t6_func(int n) {
+	TEST_CHECK_(MyGetThread() == n % MAXTHREADS,
+			"thread %d should have ID %d, but has %d",
+			n, n % MAXTHREADS, MyGetThread());
+	if (n < T6_ROUNDS) {
+		int expected = (n + d6.k) % MAXTHREADS;
+		int created = MyCreateThread(t6_func, n + d6.k);
+		TEST_CHECK_(created == expected,
+				"round %d should create thread %d, but got %d",
+				n, expected, created);
+	}
+}
+
+void churn() {
+	MyInitThreads();
+	d6.k = TEST_PARAM();
+	for (int n = 1; n < d6.k; ++n) {
+		TEST_CHECK(MyCreateThread(t6_func, n) == n);
+	}
+	t6_func(0);
+	MyExitThread();
+}
@@ -2,17 +2,21 @@
 
 /**
  * Check that thread creation can be requested even when MAXTHREADS threads
- * are active, but (-1) will be returned each time.
+ * are active, but (-1) will be returned each time. Run once for each number
+ * of holes: with holes = h, T1 to Th exit and their IDs must be reused.
  */
 
+TEST_PARAMS(create_max, "holes", 1, MAXTHREADS - 1);
+
 static struct {
-	int alive[3];
+	int holes;
+	int alive[MAXTHREADS];
 } d9;
 
 static void t9_func(int _) {
 	(void) _;
 	int tid = MyGetThread();
-	if (tid <= 2) {
+	if (tid <= d9.holes) {
 		d9.alive[tid] = 0;
 		MyExitThread();
 	}
@@ -21,7 +25,8 @@ static void t9_func(int _) {
 
 void create_max() {
 	MyInitThreads();
-	d9.alive[0] = d9.alive[1] = d9.alive[2] = 1;
+	d9.holes = TEST_PARAM();
+	for (int i = 0; i < MAXTHREADS; ++i) { d9.alive[i] = 1; }
 
 	// Max out threads, so that further creation requests return -1
 	for (int i = 1; i < MAXTHREADS; ++i) {
@@ -31,11 +36,14 @@ void create_max() {
 	TEST_CHECK(MyCreateThread(t9_func, 0) == -1);
 	TEST_CHECK(MyCreateThread(t9_func, 0) == -1);
 
-	// Kill T1 and T2, then ensure that those IDs are assigned to new threads
-	if (d9.alive[1]) { MyYieldThread(1); }
-	if (d9.alive[2]) { MyYieldThread(2); }
-	TEST_CHECK(MyCreateThread(t9_func, 0) == 1);
-	TEST_CHECK(MyCreateThread(t9_func, 0) == 2);
+	// Kill T1 to Th, then ensure that those IDs are assigned to new threads
+	for (int i = 1; i <= d9.holes; ++i) {
+		if (d9.alive[i]) { MyYieldThread(i); }
+	}
+	for (int i = 1; i <= d9.holes; ++i) {
+		TEST_CHECK_(MyCreateThread(t9_func, 0) == i,
+				"hole T%d should be reused", i);
+	}
 
 	// Now that MAXTHREADS threads are active again, creation is denied
 	TEST_CHECK(MyCreateThread(t9_func, 0) == -1);
@@ -0,0 +1,326 @@
+#include <fcntl.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "tests.h"
+
+/**
+ * Bounded model checking: run every sequence of up to `depth` operations
+ * (create, yield to each kind of target, sched, exit) from MyInitThreads(),
+ * and check each step against a model of the expected semantics.
+ *
+ * Instead of replaying each sequence from the start, every state is a
+ * process: at each step, the running thread forks one child per possible
+ * operation and waits for them one at a time. A child performs its
+ * operation and goes on exploring from the resulting state, so each edge of
+ * the state tree is executed exactly once.
+ *
+ * After each operation, the thread the kernel runs next checks that it is
+ * the one the model expects, and that the kernel call it returns from
+ * returned what the model expects. New threads check themselves when they
+ * start. Crashes and hangs (an operation taking T17_TIMEOUT seconds) fail
+ * too. The first failing sequence is reported.
+ *
+ * Yield targets are grouped into classes that the kernel cannot tell apart:
+ * itself, each other active thread, the lowest inactive ID and an invalid ID.
+ *
+ * Each level multiplies the edges by about 6.6, and about 8000 edges run
+ * per second: depth 6 (51k edges) takes some 6 s, depth 7 some 45 s and
+ * depth 8 some 5 minutes. Depths from T17_SLOW_DEPTH on are explored only
+ * when the EXPLORE_SLOW environment variable is set.
+ */
+
+#define T17_MAX_DEPTH  16
+#define T17_TIMEOUT    2
+#define T17_MAX_OPS    (MAXTHREADS + 4)
+#define T17_SLOW_DEPTH 7
+
+TEST_PARAMS(explore, "depth", 1, 8);
+
+enum { T17_CREATE, T17_YIELD, T17_SCHED, T17_EXIT };
+
+struct t17_op {
+	int kind, target;
+};
+
+// What the kernel should look like: the model of its semantics
+struct t17_model {
+	int active[MAXTHREADS];
+	int queue[MAXTHREADS], qlen;	// ready threads, in order
+	int current, last;		// running thread, last created ID
+	int from;			// thread that last switched to `current`
+	int ended;			// no threads are left
+};
+
+static struct {
+	int depth, max_depth, devnull;
+	pid_t root;
+	struct t17_op path[T17_MAX_DEPTH];
+	struct t17_model m;
+
+	// Outcome of the latest operation, for the thread that runs next
+	int switched, expect;
+
+	// Shared by all processes of the exploration
+	struct {
+		unsigned long edges, leaves, failures;
+		int fail_depth;
+		struct t17_op fail_path[T17_MAX_DEPTH];
+		char fail_msg[128];
+	} *shared;
+} d17;
+
+static void t17_func(int _);
+
+static void t17_fail_vpath(int depth, const char *fmt, va_list args) {
+	++d17.shared->failures;
+	if (d17.shared->failures == 1) {
+		d17.shared->fail_depth = depth;
+		memcpy(d17.shared->fail_path, d17.path, sizeof(d17.path));
+		vsnprintf(d17.shared->fail_msg, sizeof(d17.shared->fail_msg), fmt, args);
+	}
+}
+
+static void t17_fail_path(int depth, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void t17_fail_path(int depth, const char *fmt, ...) {
+	va_list args;
+
+	va_start(args, fmt);
+	t17_fail_vpath(depth, fmt, args);
+	va_end(args);
+}
+
+// Report a failure in this state, and stop exploring from it
+static void t17_fail(const char *fmt, ...) __attribute__((format(printf, 1, 2), noreturn));
+static void t17_fail(const char *fmt, ...) {
+	va_list args;
+
+	va_start(args, fmt);
+	t17_fail_vpath(d17.depth, fmt, args);
+	va_end(args);
+	_exit(1);
+}
+
+// Model: switch from the running thread to thread t, which is queued
+static void t17_m_switch(int t, int requeue) {
+	struct t17_model *m = &d17.m;
+	int j = 0;
+
+	for (int i = 0; i < m->qlen; ++i) {
+		if (m->queue[i] != t) { m->queue[j++] = m->queue[i]; }
+	}
+	m->qlen = j;
+	if (requeue) { m->queue[m->qlen++] = m->current; }
+	m->from = m->current;
+	m->current = t;
+	d17.switched = 1;
+}
+
+// Model: apply an operation of the running thread. Sets the expected
+// return value (if the call returns without switching) and `switched`.
+static void t17_m_apply(struct t17_op op) {
+	struct t17_model *m = &d17.m;
+
+	d17.switched = 0;
+	d17.expect = -1;
+	switch (op.kind) {
+	case T17_CREATE:
+		for (int i = 1; i <= MAXTHREADS; ++i) {
+			int t = (m->last + i) % MAXTHREADS;
+			if (!m->active[t]) {
+				m->active[t] = 1;
+				m->queue[m->qlen++] = t;
+				m->last = t;
+				d17.expect = t;
+				break;
+			}
+		}
+		break;
+	case T17_YIELD:
+		if (op.target < 0 || op.target >= MAXTHREADS || !m->active[op.target]) {
+			d17.expect = -1;
+		} else if (op.target == m->current) {
+			d17.expect = m->current;
+		} else {
+			t17_m_switch(op.target, 1);
+		}
+		break;
+	case T17_SCHED:
+		if (m->qlen > 0) { t17_m_switch(m->queue[0], 1); }
+		break;
+	case T17_EXIT:
+		m->active[m->current] = 0;
+		if (m->qlen > 0) {
+			t17_m_switch(m->queue[0], 0);
+		} else {
+			m->ended = 1;
+		}
+		break;
+	}
+}
+
+// The operations worth trying in the current state
+static int t17_ops(struct t17_op *ops) {
+	int n = 0, inactive = -1;
+
+	ops[n++] = (struct t17_op) { T17_CREATE, 0 };
+	ops[n++] = (struct t17_op) { T17_SCHED, 0 };
+	ops[n++] = (struct t17_op) { T17_EXIT, 0 };
+	for (int t = 0; t < MAXTHREADS; ++t) {
+		if (d17.m.active[t]) {
+			ops[n++] = (struct t17_op) { T17_YIELD, t };
+		} else if (inactive == -1) {
+			inactive = t;
+		}
+	}
+	if (inactive != -1) { ops[n++] = (struct t17_op) { T17_YIELD, inactive }; }
+	ops[n++] = (struct t17_op) { T17_YIELD, -1 };
+	return n;
+}
+
+// The kernel just gave the CPU to this thread: is that right?
+static void t17_check_running() {
+	alarm(0);
+	if (d17.m.ended) {
+		t17_fail("kernel ran T%d after the last thread exited", MyGetThread());
+	}
+	if (MyGetThread() != d17.m.current) {
+		t17_fail("expected T%d to run, but T%d runs",
+				d17.m.current, MyGetThread());
+	}
+}
+
+// A kernel call of this thread returned `ret`
+static void t17_check_return(int ret) {
+	int expect = d17.switched ? d17.m.from : d17.expect;
+	if (ret != expect) {
+		t17_fail("kernel call returned %d, expected %d", ret, expect);
+	}
+}
+
+static void t17_step(struct t17_op op) {
+	d17.path[d17.depth++] = op;
+	++d17.shared->edges;
+	t17_m_apply(op);
+
+	if (d17.m.ended) {
+		// The kernel ends the process; nothing to check afterwards
+		++d17.shared->leaves;
+	}
+
+	alarm(T17_TIMEOUT);
+	switch (op.kind) {
+	case T17_CREATE:
+		t17_check_return(MyCreateThread(t17_func, 0));
+		break;
+	case T17_YIELD:
+		t17_check_return(MyYieldThread(op.target));
+		break;
+	case T17_SCHED:
+		MySchedThread();
+		break;
+	case T17_EXIT:
+		MyExitThread();
+		break;
+	}
+	t17_check_running();
+}
+
+// Explore from the current state, in whichever thread is running
+static void t17_explore() {
+	struct t17_op ops[T17_MAX_OPS];
+	int n, i, status;
+	pid_t pid;
+
+	for (;;) {
+		if (d17.depth == d17.max_depth) {
+			++d17.shared->leaves;
+			_exit(0);
+		}
+
+		n = t17_ops(ops);
+		for (i = 0; i < n; ++i) {
+			fflush(stdout);
+			pid = fork();
+			if (pid == 0) { break; }
+			if (pid == -1) { t17_fail("cannot fork"); }
+			waitpid(pid, &status, 0);
+			if (WIFSIGNALED(status)) {
+				d17.path[d17.depth] = ops[i];
+				if (WTERMSIG(status) == SIGALRM) {
+					t17_fail_path(d17.depth + 1, "kernel hung");
+				} else {
+					t17_fail_path(d17.depth + 1, "kernel crashed (signal %d)",
+							WTERMSIG(status));
+				}
+			}
+		}
+		if (i == n) {
+			// All branches explored
+			if (getpid() == d17.root) { return; }
+			_exit(0);
+		}
+
+		// Child: take branch i
+		dup2(d17.devnull, STDOUT_FILENO);
+		t17_step(ops[i]);
+	}
+}
+
+static void t17_func(int _) {
+	(void) _;
+	if (!d17.switched) { t17_fail("new thread ran without a switch"); }
+	t17_check_running();
+	t17_explore();
+	// Only the root returns from t17_explore, and it never runs here
+}
+
+static void t17_print_path() {
+	static const char *names[] = { "create", "yield", "sched", "exit" };
+	char buf[TEST_MSG_MAXSIZE];
+	int len = 0;
+
+	for (int i = 0; i < d17.shared->fail_depth; ++i) {
+		struct t17_op op = d17.shared->fail_path[i];
+		len += snprintf(buf + len, sizeof(buf) - len,
+				op.kind == T17_YIELD ? "%s%s(%d)" : "%s%s",
+				i ? ", " : "", names[op.kind], op.target);
+	}
+	TEST_MSG("First failing sequence: %s", buf);
+	TEST_MSG("  %s", d17.shared->fail_msg);
+}
+
+void explore() {
+	long long start;
+	double secs;
+
+	if (TEST_PARAM() >= T17_SLOW_DEPTH && getenv("EXPLORE_SLOW") == NULL) {
+		TEST_RESULT("explore: depth %d not explored, as it takes minutes; "
+				"set EXPLORE_SLOW=1", TEST_PARAM());
+		return;
+	}
+	d17.shared = mmap(NULL, sizeof(*d17.shared), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (!TEST_CHECK(d17.shared != MAP_FAILED)) { return; }
+	d17.devnull = open("/dev/null", O_WRONLY);
+	d17.root = getpid();
+	d17.max_depth = TEST_PARAM();
+
+	MyInitThreads();
+	d17.m.active[0] = 1;
+	start = test_now_ns();
+	t17_explore();
+	secs = (test_now_ns() - start) * 1e-9;
+
+	TEST_MSG("Depth %d: %lu edges, %lu leaves in %.2f s (%.0f edges/s)",
+			d17.max_depth, d17.shared->edges, d17.shared->leaves, secs,
+			secs > 0 ? d17.shared->edges / secs : 0.0);
+	if (!TEST_CHECK_(d17.shared->failures == 0,
+				"%lu explored states diverge from the model",
+				d17.shared->failures)) {
+		t17_print_path();
+	}
+	MyExitThread();
+}
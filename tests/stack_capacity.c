@@ -0,0 +1,115 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "tests.h"
+
+/**
+ * Probe: how large a local frame can each thread use? Run with -v to see the
+ * results, and compare mytest with reftest.
+ *
+ * For each thread ID, binary search for the largest frame that thread can
+ * fill without corrupting any other thread's frame (or crashing). Each probe
+ * runs in a forked child, like protected_stack: all MAXTHREADS threads are
+ * created, each fills a frame with its own marker, and after everyone has
+ * run each thread checks that its whole frame is intact. Only the probed
+ * thread uses a large frame; the others use T16_SMALL bytes.
+ *
+ * The child reports through a shared page and its output is discarded, so
+ * that a crash, a hang (killed after T16_TIMEOUT seconds) or the kernel
+ * ending the process early only fails the probe.
+ * Each thread must be able to use at least what protected_stack assumes.
+ */
+
+#define T16_SMALL   1024
+#define T16_MAX     (2 * STACKSIZE)	// T0 runs on the process stack
+#define T16_TIMEOUT 2
+#define T16_MARKER() ((unsigned char) '\xf0' | (MyGetThread() & 0xf))
+#define T16_NEEDED  (STACKSIZE - sizeof(int) - 196)	// see protected_stack
+
+static struct {
+	int target, bytes;
+	struct {
+		int finished, bad;
+	} *shared;
+} d16;
+
+static int t16_frame_bytes(int tid) {
+	return tid == d16.target ? d16.bytes : T16_SMALL;
+}
+
+static void t16_func(int tid) {
+	unsigned char frame[t16_frame_bytes(tid)];
+
+	// Create all threads, then fill each frame. As in protected_stack, we
+	// avoid `tid` after filling, since a neighbor may have overwritten it.
+	if (tid + 1 < MAXTHREADS) { MyCreateThread(t16_func, tid + 1); }
+	MyYieldThread((MyGetThread() + 1) % MAXTHREADS);
+	memset(frame, T16_MARKER(), t16_frame_bytes(MyGetThread()));
+	MyYieldThread((MyGetThread() + 1) % MAXTHREADS);
+
+	for (int i = 0; i < t16_frame_bytes(MyGetThread()); ++i) {
+		if (frame[i] != T16_MARKER()) {
+			d16.shared->bad |= 1 << MyGetThread();
+			break;
+		}
+	}
+	if (++d16.shared->finished == MAXTHREADS) { _exit(0); }
+	MyExitThread();
+}
+
+// Can thread `target` use a frame of `bytes` bytes?
+static int t16_probe(int target, int bytes) {
+	int status;
+	pid_t pid;
+
+	d16.target = target;
+	d16.bytes = bytes;
+	d16.shared->finished = 0;
+	d16.shared->bad = 0;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0) {
+		dup2(open("/dev/null", O_WRONLY), STDOUT_FILENO);
+		alarm(T16_TIMEOUT);
+		MyInitThreads();
+		t16_func(0);
+		_exit(1);
+	}
+	if (pid == -1 || waitpid(pid, &status, 0) != pid) { return 0; }
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0
+		&& d16.shared->finished == MAXTHREADS && d16.shared->bad == 0;
+}
+
+void stack_capacity() {
+	d16.shared = mmap(NULL, sizeof(*d16.shared), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (!TEST_CHECK(d16.shared != MAP_FAILED)) { return; }
+
+	TEST_MSG("Usable frame bytes per thread (STACKSIZE = %d):", STACKSIZE);
+	for (int t = 0; t < MAXTHREADS; ++t) {
+		int good = 0, bad = T16_MAX + 1;
+
+		// Invariant: a frame of `good` bytes works, one of `bad` does not
+		if (!t16_probe(t, T16_SMALL)) {
+			bad = T16_SMALL;
+		} else if (t16_probe(t, T16_MAX)) {
+			good = T16_MAX;
+		} else {
+			good = T16_SMALL;
+			bad = T16_MAX;
+		}
+		while (bad - good > 1) {
+			int mid = good + (bad - good) / 2;
+			if (t16_probe(t, mid)) { good = mid; } else { bad = mid; }
+		}
+
+		TEST_MSG("  T%d: %6d bytes%s (%.1f%% of STACKSIZE)", t, good,
+				good == T16_MAX ? "+" : "", 100.0 * good / STACKSIZE);
+		TEST_CHECK_(good >= (int) T16_NEEDED,
+				"T%d can use %d bytes, but protected_stack needs %d",
+				t, good, (int) T16_NEEDED);
+	}
+	munmap(d16.shared, sizeof(*d16.shared));
+}
@@ -0,0 +1,125 @@
+#include <stdint.h>
+#include "tests.h"
+#include "../sync.h"
+
+/**
+ * Tests the semaphore and channel of sync.h.
+ *
+ * - Semaphore: the initial count lets that many waits through. Workers
+ *   waiting on a semaphore are released one per post, in the order they
+ *   started waiting.
+ * - Channel: producers send T21_ITEMS values each through a channel of
+ *   capacity 3, and T0 receives each producer's values in order.
+ * - Close: waiting senders and receivers get -1, sends fail, and values
+ *   already in the buffer can still be received.
+ */
+
+#define T21_WORKERS (MAXTHREADS - 1)
+#define T21_ITEMS   200
+#define T21_CAP     3
+
+static struct {
+	Sem sem;
+	Chan chan;
+	int passed, producing, order[T21_WORKERS];
+	int send_status, recv_status;
+} d21;
+
+static void t21_sem_waiter(int i) {
+	SemWait(&d21.sem);
+	d21.order[d21.passed++] = i;
+}
+
+static void t21_producer(int p) {
+	for (intptr_t n = 1; n <= T21_ITEMS; ++n) {
+		TEST_CHECK(ChanSend(&d21.chan, (void *) (p * 1000 + n)) == 0);
+	}
+	--d21.producing;
+}
+
+static void t21_blocked_sender(int _) {
+	(void) _;
+	d21.send_status = ChanSend(&d21.chan, (void *) 1);
+}
+
+static void t21_blocked_receiver(int _) {
+	void *v;
+
+	(void) _;
+	d21.recv_status = ChanRecv(&d21.chan, &v);
+}
+
+void sync_chan() {
+	int t[T21_WORKERS], last[T21_WORKERS] = { 0 };
+	void *v;
+
+	MyInitThreads();
+
+	// Misuse
+	TEST_CHECK(SemInit(&d21.sem, -1) == -1);
+	TEST_CHECK(ChanInit(&d21.chan, 0) == -1);
+	TEST_CHECK(ChanInit(&d21.chan, CHAN_MAX + 1) == -1);
+
+	// Semaphore
+	TEST_CHECK(SemInit(&d21.sem, 2) == 0);
+	SemWait(&d21.sem);
+	SemWait(&d21.sem);
+	for (int i = 0; i < T21_WORKERS; ++i) {
+		t[i] = MyCreateThread(t21_sem_waiter, i);
+		TEST_CHECK(t[i] != -1);
+		MyYieldThread(t[i]);	// returns once t[i] waits
+	}
+	TEST_CHECK(d21.passed == 0);
+	for (int i = 0; i < T21_WORKERS; ++i) {
+		SemPost(&d21.sem);
+		MyYieldThread(t[i]);
+		TEST_CHECK_(d21.passed == i + 1, "%d waiters passed after %d posts",
+				d21.passed, i + 1);
+		TEST_CHECK_(d21.order[i] == i, "worker %d passed in position %d",
+				d21.order[i], i);
+	}
+	TEST_CHECK(d21.sem.count == 0);
+
+	// Channel
+	TEST_CHECK(ChanInit(&d21.chan, T21_CAP) == 0);
+	for (int p = 1; p < T21_WORKERS; ++p) {
+		TEST_CHECK(MyCreateThread(t21_producer, p) != -1);
+		++d21.producing;
+	}
+	for (int k = 0; k < (T21_WORKERS - 1) * T21_ITEMS; ++k) {
+		intptr_t n, p;
+
+		if (!TEST_CHECK(ChanRecv(&d21.chan, &v) == 0)) { break; }
+		p = (intptr_t) v / 1000;
+		n = (intptr_t) v % 1000;
+		if (!TEST_CHECK_(p >= 1 && p < T21_WORKERS && n == last[p] + 1,
+				"received %ld out of order", (long) (intptr_t) v)) { break; }
+		last[p] = n;
+	}
+	TEST_CHECK(d21.chan.len == 0);
+	while (d21.producing > 0) { MySchedThread(); }
+
+	// Close with a waiting receiver
+	d21.recv_status = 0;
+	t[0] = MyCreateThread(t21_blocked_receiver, 0);
+	MyYieldThread(t[0]);
+	TEST_CHECK(ChanClose(&d21.chan) == 0);
+	TEST_CHECK(ChanClose(&d21.chan) == -1);
+	MyYieldThread(t[0]);
+	TEST_CHECK(d21.recv_status == -1);
+	TEST_CHECK(ChanSend(&d21.chan, NULL) == -1);
+	TEST_CHECK(ChanRecv(&d21.chan, &v) == -1);
+
+	// Close with a waiting sender and a full buffer
+	TEST_CHECK(ChanInit(&d21.chan, 1) == 0);
+	TEST_CHECK(ChanSend(&d21.chan, (void *) 7) == 0);
+	d21.send_status = 0;
+	t[0] = MyCreateThread(t21_blocked_sender, 0);
+	MyYieldThread(t[0]);
+	TEST_CHECK(ChanClose(&d21.chan) == 0);
+	MyYieldThread(t[0]);
+	TEST_CHECK(d21.send_status == -1);
+	TEST_CHECK(ChanRecv(&d21.chan, &v) == 0 && v == (void *) 7);
+	TEST_CHECK(ChanRecv(&d21.chan, &v) == -1);
+	MyExitThread();
+}
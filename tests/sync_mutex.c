@@ -0,0 +1,135 @@
+#include "tests.h"
+#include "../sync.h"
+
+/**
+ * Tests the mutex and condition variable of sync.h.
+ *
+ * - Misuse returns -1: unlocking a mutex one does not hold, locking it
+ *   twice, waiting on a condition without its mutex.
+ * - Handoff: while T0 holds a mutex, workers T1.. queue on it in order.
+ *   Unlocking makes T1 the owner and runs it at once (so T0 cannot take it
+ *   back), and the workers then get it in the order they queued. Each worker switches
+ *   inside its critical section, and no other worker may enter meanwhile.
+ * - Condition: producers and a consumer (T0) pass T20_ITEMS values each
+ *   through a two-slot buffer guarded by a mutex and two conditions, and
+ *   every value arrives. Finally a broadcast wakes all waiters.
+ */
+
+#define T20_WORKERS (MAXTHREADS - 1)
+#define T20_ITEMS   200
+#define T20_SLOTS   2
+
+static struct {
+	Mutex m;
+	Cond not_full, not_empty, go;
+	int inside, entered, order[T20_WORKERS];
+	int buf[T20_SLOTS], head, len, producing, ready, woken;
+} d20;
+
+static void t20_locker(int i) {
+	TEST_CHECK(MutexLock(&d20.m) == 0);
+	TEST_CHECK_(d20.inside == 0, "T%d entered while another thread was inside",
+			MyGetThread());
+	d20.inside = 1;
+	d20.order[d20.entered++] = i;
+	MySchedThread();
+	d20.inside = 0;
+	TEST_CHECK(MutexUnlock(&d20.m) == 0);
+}
+
+static void t20_producer(int p) {
+	for (int n = 1; n <= T20_ITEMS; ++n) {
+		MutexLock(&d20.m);
+		while (d20.len == T20_SLOTS) {
+			TEST_CHECK(CondWait(&d20.not_full, &d20.m) == 0);
+		}
+		d20.buf[(d20.head + d20.len++) % T20_SLOTS] = p * 1000 + n;
+		CondSignal(&d20.not_empty);
+		MutexUnlock(&d20.m);
+	}
+	--d20.producing;
+}
+
+static void t20_waiter(int _) {
+	(void) _;
+	MutexLock(&d20.m);
+	while (!d20.ready) { CondWait(&d20.go, &d20.m); }
+	++d20.woken;
+	MutexUnlock(&d20.m);
+}
+
+void sync_mutex() {
+	int t[T20_WORKERS], last[T20_WORKERS + 1] = { 0 };
+	long long sum = 0, expected = 0;
+
+	MyInitThreads();
+	MutexInit(&d20.m);
+	CondInit(&d20.not_full);
+	CondInit(&d20.not_empty);
+	CondInit(&d20.go);
+
+	// Misuse
+	TEST_CHECK(MutexUnlock(&d20.m) == -1);
+	TEST_CHECK(CondWait(&d20.go, &d20.m) == -1);
+	TEST_CHECK(MutexLock(&d20.m) == 0);
+	TEST_CHECK(MutexLock(&d20.m) == -1);
+
+	// Handoff in FIFO order
+	for (int i = 0; i < T20_WORKERS; ++i) {
+		t[i] = MyCreateThread(t20_locker, i);
+		TEST_CHECK(t[i] != -1);
+		MyYieldThread(t[i]);	// returns once t[i] waits for the mutex
+	}
+	TEST_CHECK(d20.entered == 0);
+	TEST_CHECK(MutexUnlock(&d20.m) == 0);
+	TEST_CHECK_(d20.entered > 0, "unlock should hand the mutex to T%d and run it",
+			t[0]);
+	TEST_CHECK(MutexLock(&d20.m) == 0);	// after all the workers
+	TEST_CHECK(d20.entered == T20_WORKERS);
+	for (int i = 0; i < d20.entered; ++i) {
+		TEST_CHECK_(d20.order[i] == i, "worker %d entered in position %d",
+				d20.order[i], i);
+	}
+	TEST_CHECK(MutexUnlock(&d20.m) == 0);
+
+	// Bounded buffer: T0 consumes what the producers produce
+	for (int p = 1; p < T20_WORKERS; ++p) {
+		TEST_CHECK(MyCreateThread(t20_producer, p) != -1);
+		++d20.producing;
+		for (int n = 1; n <= T20_ITEMS; ++n) { expected += p * 1000 + n; }
+	}
+	for (int k = 0; k < (T20_WORKERS - 1) * T20_ITEMS; ++k) {
+		int v, p;
+
+		MutexLock(&d20.m);
+		while (d20.len == 0) { CondWait(&d20.not_empty, &d20.m); }
+		v = d20.buf[d20.head];
+		d20.head = (d20.head + 1) % T20_SLOTS;
+		--d20.len;
+		CondSignal(&d20.not_full);
+		MutexUnlock(&d20.m);
+
+		p = v / 1000;
+		TEST_CHECK_(p >= 1 && p < T20_WORKERS && v % 1000 == last[p] + 1,
+				"value %d out of order after %d", v, p >= 1 && p < T20_WORKERS ? last[p] : -1);
+		if (p >= 1 && p < T20_WORKERS) { last[p] = v % 1000; }
+		sum += v;
+	}
+	TEST_CHECK(sum == expected);
+	while (d20.producing > 0) { MySchedThread(); }
+
+	// Broadcast
+	for (int i = 0; i < T20_WORKERS; ++i) {
+		t[i] = MyCreateThread(t20_waiter, 0);
+		if (t[i] != -1) { MyYieldThread(t[i]); }
+	}
+	TEST_CHECK(d20.woken == 0);
+	MutexLock(&d20.m);
+	d20.ready = 1;
+	CondBroadcast(&d20.go);
+	MutexUnlock(&d20.m);
+	for (int i = 0; i < T20_WORKERS && d20.woken < T20_WORKERS; ++i) { MySchedThread(); }
+	TEST_CHECK_(d20.woken == T20_WORKERS, "%d of %d waiters woke up",
+			d20.woken, T20_WORKERS);
+	MyExitThread();
+}
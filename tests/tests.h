@@ -20,4 +20,12 @@
 
 #define STACKSIZE	65536		// maximum size of thread stack
 
+// Monotonic clock in nanoseconds, for tests that report timings
+#include <time.h>
+static inline long long test_now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 #endif
@@ -0,0 +1,102 @@
+#include "tests.h"
+#include "../timer.h"
+
+/**
+ * Tests the sleeps of timer.h.
+ *
+ * - Sleepers with deadlines on all levels of the wheel used here (up to 4500
+ *   ticks) wake in deadline order, never early and at most T23_LATE ns late.
+ *   While they all sleep, the process must block rather than spin: it may
+ *   use at most half of the elapsed time as CPU time.
+ * - TimerSchedThread() runs the awake thread and skips a sleeper, and
+ *   TimerWake() wakes that sleeper long before its deadline.
+ */
+
+#define T23_SLEEPERS 8
+#define T23_LATE     20000000LL		// 20 ms, below a level 1 rotation
+#define T23_MARGIN   10000000LL		// for all sleepers to fall asleep
+
+static const long long t23_sleeps[T23_SLEEPERS] = {	// in us
+	120, 250, 400, 700, 900, 5000, 45000, 46000
+};
+
+static struct {
+	long long start;
+	int started, woke, order[T23_SLEEPERS];
+	long long late[T23_SLEEPERS];
+	int ran, long_sleeper_done;
+} d23;
+
+static void t23_sleeper(int i) {
+	long long deadline;
+
+	// Wait until all sleepers have started, so that none starts late
+	++d23.started;
+	while (!d23.start) { TimerSchedThread(); }
+	deadline = d23.start + t23_sleeps[i] * 1000;
+	TimerSleepUntil(deadline);
+	d23.late[i] = TimerNow() - deadline;
+	d23.order[d23.woke++] = i;
+}
+
+static void t23_worker(int _) {
+	(void) _;
+	d23.ran = 1;
+}
+
+static void t23_long_sleeper(int _) {
+	(void) _;
+	TimerSleep(10000000000LL);	// 10 s
+	d23.long_sleeper_done = 1;
+}
+
+static long long t23_cpu_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void timer_sleep() {
+	long long cpu, wall;
+	int t;
+
+	MyInitThreads();
+	TimerInit();
+
+	// Sleepers, created in reverse deadline order
+	for (int i = T23_SLEEPERS - 1; i >= 0; --i) {
+		TEST_CHECK(TimerCreateThread(t23_sleeper, i) != -1);
+	}
+	while (d23.started < T23_SLEEPERS) { TimerSchedThread(); }
+	d23.start = TimerNow() + T23_MARGIN;
+	cpu = t23_cpu_ns();
+	TimerSleepUntil(d23.start + 50000000LL);
+	wall = TimerNow() - d23.start + T23_MARGIN;
+	cpu = t23_cpu_ns() - cpu;
+
+	TEST_CHECK_(d23.woke == T23_SLEEPERS, "%d of %d sleepers woke up",
+			d23.woke, T23_SLEEPERS);
+	for (int k = 0; k < d23.woke; ++k) {
+		int i = d23.order[k];
+		TEST_CHECK_(i == k, "the %lld us sleeper woke in position %d",
+				t23_sleeps[i], k);
+		TEST_CHECK_(d23.late[i] >= 0 && d23.late[i] < T23_LATE,
+				"the %lld us sleeper woke %lld ns late", t23_sleeps[i], d23.late[i]);
+	}
+	TEST_CHECK_(cpu < wall / 2, "used %lld ns of CPU in %lld ns asleep", cpu, wall);
+
+	// Skipping a sleeper, and waking it early
+	t = TimerCreateThread(t23_long_sleeper, 0);
+	TEST_CHECK(t != -1);
+	TEST_CHECK(TimerCreateThread(t23_worker, 0) != -1);
+	MyYieldThread(t);	// it starts sleeping and passes the CPU on
+	TimerSchedThread();
+	TEST_CHECK(d23.ran);
+	TEST_CHECK(!d23.long_sleeper_done);
+	TEST_CHECK(TimerWake(t) == 0);
+	TEST_CHECK(TimerWake(t) == -1);
+	TimerSchedThread();
+	TEST_CHECK(d23.long_sleeper_done);
+	TEST_CHECK(TimerWake(0) == -1);
+	MyExitThread();
+}
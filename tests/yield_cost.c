@@ -0,0 +1,38 @@
+#include "tests.h"
+
+/**
+ * Tests the cost of yields against budgets (see TEST_PERF_CHECK).
+ *
+ * - A switch to another thread and back costs at most T26_ROUND_TRIP
+ *   calibration units (tens of microseconds on current machines).
+ * - A yield to the running thread, which switches nothing, costs under 5%
+ *   of one switch.
+ *
+ * Runners that instrument the kernel calls do not check them.
+ */
+
+#define T26_ROUND_TRIP 20000
+
+static struct {
+	int done;
+} d26;
+
+static void t26_partner(int _) {
+	(void) _;
+	while (!d26.done) { MyYieldThread(0); }
+}
+
+void yield_cost() {
+	int t;
+
+	MyInitThreads();
+	t = MyCreateThread(t26_partner, 0);
+	if (!TEST_CHECK(t != -1)) { MyExitThread(); }
+
+	TEST_PERF_CHECK(T26_ROUND_TRIP, "yield/switch and back") { MyYieldThread(t); }
+	TEST_PERF_CHECK(0.05 * TEST_PERF_LAST() / 2, "yield/self") { MyYieldThread(0); }
+
+	d26.done = 1;
+	MyYieldThread(t);
+	MyExitThread();
+}
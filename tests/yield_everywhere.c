@@ -1,9 +1,12 @@
 #include "tests.h"
 
 /**
- * Yielding to and from all threads (including main thread).
+ * Yielding to and from all threads (including main thread). Run once for
+ * each number n of threads yielded to, i.e. T1 to Tn.
  */
 
+TEST_PARAMS(yield_everywhere, "n", 1, MAXTHREADS - 1);
+
 static void t5_func(int source) {
 	MyYieldThread(source);
 }
@@ -11,7 +14,7 @@ static void t5_func(int source) {
 void yield_everywhere() {
 	MyInitThreads();
 	int me = MyGetThread();
-	for (int i = 1; i <= 9; ++i) {
+	for (int i = 1; i <= TEST_PARAM(); ++i) {
 		TEST_CHECK(MyYieldThread(MyCreateThread(t5_func, me)) == i);
 		TEST_CHECK(MyYieldThread(me) == me);
 	}
@@ -0,0 +1,330 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+/**
+ * Cooperative sleep on top of the thread kernel: a thread sleeps until a
+ * deadline without spinning, and the process blocks in the OS when every
+ * thread sleeps.
+ *
+ * Sleepers are kept in a hierarchical timer wheel of TIMER_LEVELS levels of
+ * 64 slots: level 0 holds the deadlines of the next 64 ticks, level 1 those
+ * of the next 64 * 64 ticks in slots of 64 ticks, and so on. Inserting is
+ * O(1), and as time passes each slot of a higher level is cascaded into the
+ * level below when its turn comes. Each level keeps a bitmap of its
+ * occupied slots, so advancing the wheel jumps from one occupied slot to
+ * the next rather than visiting every tick. A deadline is rounded up to a tick, so
+ * sleepers never wake early and at most TIMER_TICK_NS late (plus the
+ * switches to get there).
+ *
+ * The kernel does not know that a thread sleeps, so the library tracks the
+ * threads created with TimerCreateThread() (and the one that called
+ * TimerInit()) and which of them sleep:
+ *
+ * - TimerSchedThread() is MySchedThread() for this runtime: it wakes the due
+ *   sleepers and yields directly to the next thread that is awake, skipping
+ *   sleepers without switching to them.
+ * - A sleeper that gets the CPU anyway (through MySchedThread() or a yield)
+ *   passes it on to the next awake thread.
+ * - When all tracked threads sleep, the sleeper that notices blocks in
+ *   clock_nanosleep() until the earliest deadline.
+ *
+ * So create every thread that can wake a sleeper (by waking it or by making
+ * progress) with TimerCreateThread(); threads created otherwise are not
+ * scheduled by TimerSchedThread(), and may wait until a deadline. A thread
+ * should return from its function rather than call MyExitThread().
+ *
+ * Like bench.h, the state is static: use it from one source file, and call
+ * TimerInit() after MyInitThreads().
+ *
+ *   TimerInit();
+ *   TimerCreateThread(worker, 0);
+ *   TimerSleep(1000000);          // 1 ms
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef TIMER_TICK_NS
+#define TIMER_TICK_NS 10000LL		// 10 us
+#endif
+#ifndef TIMER_LEVELS
+#define TIMER_LEVELS  5			// 64^5 ticks: about 3 hours of 10 us
+#endif
+#define TIMER_SLOTS   64
+
+// A sleeping thread. It is on the sleeper's stack.
+struct TimerEntry {
+	long long deadline;		// ns, CLOCK_MONOTONIC
+	long long tick;			// deadline rounded up to a tick
+	int tid;
+	struct TimerEntry *next;
+};
+
+enum { TIMER_UNTRACKED__, TIMER_AWAKE__, TIMER_ASLEEP__ };
+
+static struct {
+	struct TimerEntry *wheel[TIMER_LEVELS][TIMER_SLOTS];
+	unsigned long long occupied[TIMER_LEVELS];	// bit s: wheel[level][s] has entries
+	long long now_tick;		// all ticks up to this one have expired
+	int state[MAXTHREADS];
+	struct TimerEntry *entry[MAXTHREADS];	// of each sleeper
+	int sleepers;
+	int woken[MAXTHREADS], woken_head, woken_len;	// in deadline order
+	struct {
+		void (*func)(int);
+		int param, used;
+	} start[MAXTHREADS];		// of threads not yet started
+} timer__;
+
+static inline long long TimerNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void timer_insert__(struct TimerEntry *e) {
+	long long ahead = e->tick - timer__.now_tick;
+	int level = 0;
+
+	// Level l holds the entries due within 64^(l+1) ticks; later ones wait
+	// in the top level and are cascaded again when their slot comes round
+	while (level < TIMER_LEVELS - 1 && ahead >= (1LL << (6 * (level + 1)))) { ++level; }
+	if (ahead >= (1LL << (6 * TIMER_LEVELS))) {
+		ahead = (1LL << (6 * TIMER_LEVELS)) - 1;
+	}
+	{
+		int slot = ((timer__.now_tick + ahead) >> (6 * level)) & (TIMER_SLOTS - 1);
+		e->next = timer__.wheel[level][slot];
+		timer__.wheel[level][slot] = e;
+		timer__.occupied[level] |= 1ULL << slot;
+	}
+}
+
+// Empty a slot of the wheel, and return its entries
+static inline struct TimerEntry *timer_take__(int level, int slot) {
+	struct TimerEntry *e = timer__.wheel[level][slot];
+
+	timer__.wheel[level][slot] = NULL;
+	timer__.occupied[level] &= ~(1ULL << slot);
+	return e;
+}
+
+// The first tick after now_tick at which there is work, or `to` if it comes
+// first: the tick of an occupied level-0 slot, or the start of an occupied
+// slot of a higher level, which is then cascaded. Nothing happens at the
+// ticks in between, so timer_advance__() skips them.
+static inline long long timer_next_tick__(long long to) {
+	long long next = to;
+
+	for (int level = 0; level < TIMER_LEVELS; ++level) {
+		unsigned long long bits = timer__.occupied[level];
+		long long first = (timer__.now_tick >> (6 * level)) + 1;	// in slots of this level
+		int shift = first & (TIMER_SLOTS - 1);
+		long long t;
+
+		if (bits == 0) { continue; }
+		// Rotate the bitmap so that bit 0 is the slot of `first`
+		bits = (bits >> shift) | (bits << ((TIMER_SLOTS - shift) & (TIMER_SLOTS - 1)));
+		t = (first + __builtin_ctzll(bits)) << (6 * level);
+		if (t < next) { next = t; }
+	}
+	return next;
+}
+
+// Wake the sleepers due by tick `to`
+static inline void timer_advance__(long long to) {
+	if (timer__.sleepers == 0) {
+		if (to > timer__.now_tick) { timer__.now_tick = to; }
+		return;
+	}
+	while (timer__.now_tick < to) {
+		long long t = timer__.now_tick = timer_next_tick__(to);
+		struct TimerEntry *e, *next;
+
+		// Cascade the slots that start at this tick, from the top level down
+		for (int level = TIMER_LEVELS - 1; level > 0; --level) {
+			if (t & ((1LL << (6 * level)) - 1)) { continue; }
+			e = timer_take__(level, (t >> (6 * level)) & (TIMER_SLOTS - 1));
+			for (; e; e = next) {
+				next = e->next;
+				timer_insert__(e);
+			}
+		}
+
+		e = timer_take__(0, t & (TIMER_SLOTS - 1));
+		for (; e; e = next) {
+			next = e->next;
+			if (e->tick > t) {	// beyond the wheel's span: insert again
+				timer_insert__(e);
+				continue;
+			}
+			timer__.state[e->tid] = TIMER_AWAKE__;
+			timer__.entry[e->tid] = NULL;
+			--timer__.sleepers;
+			if (timer__.woken_len < MAXTHREADS) {
+				timer__.woken[(timer__.woken_head + timer__.woken_len++) % MAXTHREADS] = e->tid;
+			}
+		}
+		if (timer__.sleepers == 0) {
+			timer__.now_tick = to;
+		}
+	}
+}
+
+static inline void timer_expire__() {
+	timer_advance__(TimerNow() / TIMER_TICK_NS);
+}
+
+// Pop the first sleeper woken since, other than `me`, that is still awake, or
+// -1. With `before_me`, only one that was woken before `me` (which is then
+// popped itself once it comes first).
+static inline int timer_pop_woken__(int me, int before_me) {
+	if (before_me) {
+		int k = 0;
+		while (k < timer__.woken_len && timer__.woken[(timer__.woken_head + k) % MAXTHREADS] != me) { ++k; }
+		if (k == timer__.woken_len) { return -1; }
+	}
+	while (timer__.woken_len > 0) {
+		int t = timer__.woken[timer__.woken_head];
+		timer__.woken_head = (timer__.woken_head + 1) % MAXTHREADS;
+		--timer__.woken_len;
+		if (t == me) {
+			if (before_me) { return -1; }
+			continue;
+		}
+		if (timer__.state[t] == TIMER_AWAKE__) { return t; }
+	}
+	return -1;
+}
+
+// The thread to run after `me`: the sleepers woken since first, in deadline
+// order, else the next awake tracked thread after `me`, or -1
+static inline int timer_next_awake__(int me) {
+	int t = timer_pop_woken__(me, 0);
+
+	if (t != -1) { return t; }
+	for (int i = 1; i < MAXTHREADS; ++i) {
+		t = (me + i) % MAXTHREADS;
+		if (timer__.state[t] == TIMER_AWAKE__) { return t; }
+	}
+	return -1;
+}
+
+// Yield to awake thread t; stop tracking it if it turns out to have exited
+static inline void timer_yield__(int t) {
+	if (MyYieldThread(t) == -1) { timer__.state[t] = TIMER_UNTRACKED__; }
+}
+
+static inline void TimerInit() {
+	memset(&timer__, 0, sizeof(timer__));
+	timer__.now_tick = TimerNow() / TIMER_TICK_NS;
+	timer__.state[MyGetThread()] = TIMER_AWAKE__;
+}
+
+static void timer_start__(int slot) {
+	void (*func)(int) = timer__.start[slot].func;
+	int param = timer__.start[slot].param;
+
+	timer__.start[slot].used = 0;
+	func(param);
+	timer__.state[MyGetThread()] = TIMER_UNTRACKED__;
+}
+
+// MyCreateThread() for a thread that the timers track
+static inline int TimerCreateThread(void (*func)(int), int param) {
+	int slot = 0, t;
+
+	while (slot < MAXTHREADS && timer__.start[slot].used) { ++slot; }
+	if (slot == MAXTHREADS) { return -1; }
+	timer__.start[slot].func = func;
+	timer__.start[slot].param = param;
+	timer__.start[slot].used = 1;
+	if ((t = MyCreateThread(timer_start__, slot)) == -1) {
+		timer__.start[slot].used = 0;
+		return -1;
+	}
+	timer__.state[t] = TIMER_AWAKE__;
+	return t;
+}
+
+// Wake the due sleepers and yield to the next awake thread, if any
+static inline void TimerSchedThread() {
+	int t;
+
+	timer_expire__();
+	if ((t = timer_next_awake__(MyGetThread())) != -1) { timer_yield__(t); }
+}
+
+static inline void TimerSleepUntil(long long deadline) {
+	struct TimerEntry e;
+	int me = MyGetThread();
+
+	if (deadline <= TimerNow()) { return; }
+	e.deadline = deadline;
+	e.tick = (deadline + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+	e.tid = me;
+	timer_insert__(&e);
+	timer__.state[me] = TIMER_ASLEEP__;
+	timer__.entry[me] = &e;
+	++timer__.sleepers;
+
+	for (;;) {
+		int t;
+
+		timer_expire__();
+		if (timer__.state[me] != TIMER_ASLEEP__) {
+			// Let the sleepers that were due before us run first
+			if ((t = timer_pop_woken__(me, 1)) == -1) { break; }
+			timer_yield__(t);
+			continue;
+		}
+		if ((t = timer_next_awake__(me)) != -1) {
+			timer_yield__(t);
+			continue;
+		}
+
+		// Every tracked thread sleeps: block until the earliest deadline
+		long long earliest = e.tick * TIMER_TICK_NS;
+		for (int i = 0; i < MAXTHREADS; ++i) {
+			if (timer__.entry[i] && timer__.entry[i]->tick * TIMER_TICK_NS < earliest) {
+				earliest = timer__.entry[i]->tick * TIMER_TICK_NS;
+			}
+		}
+		struct timespec ts = { earliest / 1000000000LL, earliest % 1000000000LL };
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) { }
+	}
+}
+
+static inline void TimerSleep(long long ns) {
+	TimerSleepUntil(TimerNow() + ns);
+}
+
+// Wake thread t before its deadline. Returns -1 if t does not sleep.
+static inline int TimerWake(int t) {
+	struct TimerEntry **p;
+	struct TimerEntry *e;
+
+	if (t < 0 || t >= MAXTHREADS || timer__.state[t] != TIMER_ASLEEP__) { return -1; }
+	e = timer__.entry[t];
+	for (int level = 0; level < TIMER_LEVELS; ++level) {
+		for (int slot = 0; slot < TIMER_SLOTS; ++slot) {
+			for (p = &timer__.wheel[level][slot]; *p; p = &(*p)->next) {
+				if (*p == e) {
+					*p = e->next;
+					if (!timer__.wheel[level][slot]) {
+						timer__.occupied[level] &= ~(1ULL << slot);
+					}
+					goto found;
+				}
+			}
+		}
+	}
+found:
+	timer__.state[t] = TIMER_AWAKE__;
+	timer__.entry[t] = NULL;
+	--timer__.sleepers;
+	return 0;
+}
+
+#endif
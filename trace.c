@@ -0,0 +1,138 @@
+/**
+ * Kernel call recorder, linked into the mytrace and reftrace runners.
+ *
+ * Like the profiling runners (see apiprof.c), these are linked with
+ * -Wl,--wrap for the kernel API functions, and the wrappers below append a
+ * record of each create, yield, sched and exit that a test makes to a trace
+ * (see trace.h) before passing the call on to the kernel. A thread that
+ * returns from its function exits through the exit wrapper, so that its
+ * exit is recorded like an explicit one.
+ *
+ * The trace is written to the file named by the TRACE environment variable,
+ * or to test.trace. MyInitThreads() starts a new trace, so record one test
+ * per run. Only the test's own process is recorded, not processes it forks.
+ * The trace is closed when the test ends, and written out as far as it got
+ * if the test crashes:
+ *
+ *   TRACE=all75.trace ./reftrace all75
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "aux.h"
+#include "umix.h"
+#include "mykernel4.h"
+#include "trace.h"
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#ifdef USE_REFERENCE_KERNEL
+#define API(name) name
+#else
+#define API(name) My##name
+#endif
+#define CAT2(a, b) a##b
+#define CAT(a, b)  CAT2(a, b)
+#define WRAP(name) CAT(__wrap_, API(name))
+#define REAL(name) CAT(__real_, API(name))
+
+void REAL(InitThreads)();
+int  REAL(CreateThread)(void (*func)(), int param);
+int  REAL(YieldThread)(int t);
+void REAL(SchedThread)();
+void REAL(ExitThread)();
+void WRAP(ExitThread)();
+
+static struct {
+	TraceWriter w;
+	const char *path;
+
+	// Functions of created threads that have not started yet
+	struct {
+		void (*func)();
+		int param, used;
+	} starts[MAXTHREADS];
+} rec;
+
+// The end hook of the test (see acutest.h). After a crash, only write out
+// the buffer, so that the last calls, which led to the crash, are kept.
+static void r_close(int sig) {
+	if (rec.w.buf == NULL) { return; }
+	if (sig != 0) {
+		TraceWriterFlush(&rec.w);
+		return;
+	}
+	fprintf(stderr, "Recorded %llu kernel calls to %s\n", rec.w.records, rec.path);
+	if (TraceWriterClose(&rec.w) == -1) {
+		perror(rec.path);
+	}
+}
+
+static void r_write(int op, int ret, int arg) {
+	if (rec.w.buf != NULL && getpid() == TEST_PID()) { TraceWrite(&rec.w, op, API(GetThread)(), ret, arg); }
+}
+
+// Every created thread starts here, so that returning from the thread
+// function exits through the wrapper
+static void r_start(int slot) {
+	void (*func)() = rec.starts[slot].func;
+	int param = rec.starts[slot].param;
+
+	rec.starts[slot].used = 0;
+	func(param);
+	WRAP(ExitThread)();
+}
+
+__attribute__((constructor)) static void r_init() {
+	test_end_hook__ = r_close;
+}
+
+void WRAP(InitThreads)() {
+	test_perf_off__ = "kernel calls are traced";
+	for (int i = 0; i < MAXTHREADS; ++i) { rec.starts[i].used = 0; }
+	if (getpid() != TEST_PID()) {
+		REAL(InitThreads)();
+		return;
+	}
+	r_close(0);
+	if ((rec.path = getenv("TRACE")) == NULL) { rec.path = "test.trace"; }
+	if (TraceWriterOpen(&rec.w, rec.path) == -1) {
+		perror(rec.path);
+	}
+	REAL(InitThreads)();
+}
+
+int WRAP(CreateThread)(void (*func)(), int param) {
+	int slot, created;
+
+	for (slot = 0; slot < MAXTHREADS && rec.starts[slot].used; ++slot);
+	if (slot == MAXTHREADS) {
+		// No free slot (cannot happen with a correct kernel): its exit, if
+		// the thread returns, is not recorded
+		created = REAL(CreateThread)(func, param);
+	} else {
+		rec.starts[slot].func = func;
+		rec.starts[slot].param = param;
+		rec.starts[slot].used = 1;
+		created = REAL(CreateThread)(r_start, slot);
+		if (created == -1) { rec.starts[slot].used = 0; }
+	}
+	r_write(TRACE_CREATE, created, param);
+	return created;
+}
+
+int WRAP(YieldThread)(int t) {
+	r_write(TRACE_YIELD, 0, t);
+	return REAL(YieldThread)(t);
+}
+
+void WRAP(SchedThread)() {
+	r_write(TRACE_SCHED, 0, 0);
+	REAL(SchedThread)();
+}
+
+void WRAP(ExitThread)() {
+	r_write(TRACE_EXIT, 0, 0);
+	REAL(ExitThread)();
+}
@@ -0,0 +1,208 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Binary traces of kernel API calls: the creates, yields, scheds and exits
+ * of a run, each tagged with the thread that made it.
+ *
+ * A trace is a 16-byte header followed by one 8-byte record per call, in
+ * the order the calls were made:
+ *
+ *   header   "UMXTRACE", then TRACE_VERSION and MAXTHREADS as uint32_t
+ *   record   struct TraceRecord
+ *
+ * Numbers are in the byte order of the machine that wrote the trace. There
+ * is no record count: a trace ends where the file ends, so a recording cut
+ * short is valid up to its last complete record. The writer keeps up to
+ * TRACE_BUFFER bytes of records in memory, which are lost if the process
+ * dies before TraceWriterFlush() or TraceWriterClose(); the recorder writes
+ * them out when the test crashes.
+ *
+ * Traces are recorded by the mytrace and reftrace runners (see trace.c) and
+ * replayed by benchmarks/trace_replay.c. The reader maps the file instead
+ * of reading it, and releases the pages it has walked past, so traces of
+ * any size stream through a resident set of about TRACE_WINDOW bytes. The
+ * writer buffers records itself rather than through stdio, whose buffer a
+ * forked process would write out again when it exits.
+ *
+ *   TraceWriter w;     TraceWriterOpen(&w, "t.trace");
+ *   TraceWrite(&w, TRACE_YIELD, 0, 0, 3);      TraceWriterClose(&w);
+ *   TraceReader r;     TraceOpen(&r, "t.trace");
+ *   for (const struct TraceRecord *rec; (rec = TraceNext(&r)); ) { ... }
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TRACE_MAGIC   "UMXTRACE"
+#define TRACE_VERSION 1
+#ifndef TRACE_WINDOW
+#define TRACE_WINDOW  (64 << 20)	// bytes read before releasing them
+#endif
+#define TRACE_BUFFER  (1 << 20)		// bytes written at a time
+
+enum { TRACE_CREATE = 1, TRACE_YIELD, TRACE_SCHED, TRACE_EXIT };
+
+struct TraceHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t maxthreads;
+};
+
+struct TraceRecord {
+	uint8_t op;		// TRACE_CREATE...
+	int8_t tid;		// the calling thread
+	int16_t ret;		// TRACE_CREATE: the ID returned
+	int32_t arg;		// TRACE_CREATE: the parameter; TRACE_YIELD: the target
+};
+
+typedef struct {
+	int fd;
+	char *buf;		// what is not written out yet; NULL once closed
+	size_t used;
+	unsigned long long records;
+} TraceWriter;
+
+typedef struct {
+	const char *map;
+	size_t len;
+	size_t pos;		// offset of the next record
+	size_t released;	// bytes before this offset were released
+} TraceReader;
+
+// Create (or truncate) a trace file. Returns -1 with errno set on error.
+static inline int TraceWriterOpen(TraceWriter *w, const char *path) {
+	struct TraceHeader h;
+
+	w->buf = NULL;
+	if ((w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) { return -1; }
+	if ((w->buf = malloc(TRACE_BUFFER)) == NULL) {
+		close(w->fd);
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+	h.version = TRACE_VERSION;
+	h.maxthreads = MAXTHREADS;
+	memcpy(w->buf, &h, sizeof(h));
+	w->used = sizeof(h);
+	w->records = 0;
+	return 0;
+}
+
+// Write out the buffer. Returns -1 with errno set on error.
+static inline int TraceWriterFlush(TraceWriter *w) {
+	size_t done = 0;
+
+	while (done < w->used) {
+		ssize_t n = write(w->fd, w->buf + done, w->used - done);
+
+		if (n == -1 && errno == EINTR) { continue; }
+		if (n == -1) { return -1; }
+		done += n;
+	}
+	w->used = 0;
+	return 0;
+}
+
+static inline void TraceWrite(TraceWriter *w, int op, int tid, int ret, int arg) {
+	struct TraceRecord rec;
+
+	rec.op = op;
+	rec.tid = tid;
+	rec.ret = ret;
+	rec.arg = arg;
+	if (w->used + sizeof(rec) > TRACE_BUFFER) { TraceWriterFlush(w); }
+	memcpy(w->buf + w->used, &rec, sizeof(rec));
+	w->used += sizeof(rec);
+	++w->records;
+}
+
+static inline int TraceWriterClose(TraceWriter *w) {
+	int ret = TraceWriterFlush(w);
+
+	if (close(w->fd) == -1) { ret = -1; }
+	free(w->buf);
+	w->buf = NULL;
+	return ret;
+}
+
+// Map a trace file. Returns -1 with errno set on error, EINVAL if the file
+// is not a trace of this version, or for another MAXTHREADS.
+static inline int TraceOpen(TraceReader *r, const char *path) {
+	const struct TraceHeader *h;
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	void *map;
+
+	if (fd == -1) { return -1; }
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+	if ((size_t) st.st_size < sizeof(*h)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) { return -1; }
+
+	h = (const struct TraceHeader *) map;
+	if (memcmp(h->magic, TRACE_MAGIC, sizeof(h->magic)) != 0 ||
+			h->version != TRACE_VERSION || h->maxthreads != MAXTHREADS) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	r->map = (const char *) map;
+	r->len = st.st_size;
+	r->pos = r->released = sizeof(*h);
+	return 0;
+}
+
+// The next record, without moving past it, or NULL at the end
+static inline const struct TraceRecord *TracePeek(const TraceReader *r) {
+	if (r->pos + sizeof(struct TraceRecord) > r->len) { return NULL; }
+	return (const struct TraceRecord *) (r->map + r->pos);
+}
+
+// The next record, moving past it, or NULL at the end
+static inline const struct TraceRecord *TraceNext(TraceReader *r) {
+	const struct TraceRecord *rec = TracePeek(r);
+
+	if (rec == NULL) { return NULL; }
+	r->pos += sizeof(*rec);
+	if (r->pos - r->released >= TRACE_WINDOW) {
+		// Drop the pages read so far; they would be read again from the file
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t end = (r->pos - sizeof(*rec)) / page * page;
+
+		if (end > r->released) {
+			size_t start = r->released / page * page;
+			madvise((void *) (r->map + start), end - start, MADV_DONTNEED);
+			r->released = end;
+		}
+	}
+	return rec;
+}
+
+// The number of records in the trace
+static inline size_t TraceLength(const TraceReader *r) {
+	return (r->len - sizeof(struct TraceHeader)) / sizeof(struct TraceRecord);
+}
+
+static inline void TraceClose(TraceReader *r) {
+	munmap((void *) r->map, r->len);
+	r->map = NULL;
+}
+
+#endif